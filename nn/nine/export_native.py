@@ -0,0 +1,148 @@
+"""Export a conv_4x64 network for the native inference engine.
+
+Batch normalization is folded into the preceding convolutions, and the weights
+are written as a flat little-endian file read by src/zero/native_net.cpp.
+
+With --calibration-data, positions from the states*.json experience files in
+that directory are run through the network to measure the range of the input
+activations of each tower layer.  The ranges are appended to the file and are
+required for int8 inference (--quantized).
+"""
+import glob
+import json
+import os
+import struct
+
+import click
+import numpy as np
+import torch
+import torch.nn.functional as F
+
+from conv_4x64 import GoNet
+
+
+MAGIC = b'DLGONET1'
+
+
+def fold(conv, bn):
+    """Fold batch normalization into convolution weights and bias."""
+    scale = bn.weight / torch.sqrt(bn.running_var + bn.eps)
+    weight = conv.weight * scale.reshape(-1, 1, 1, 1)
+    bias = (conv.bias - bn.running_mean) * scale + bn.bias
+    return weight, bias
+
+
+def load_model(path):
+    if path.endswith('.ts'):
+        state = torch.jit.load(path).state_dict()
+    else:
+        state = torch.load(path)
+    in_channels = state['pb.0.weight'].shape[1]
+    grid_size = int(round(state['value_stack.4.weight'].shape[1] ** 0.5))
+    model = GoNet(in_channels=in_channels, grid_size=grid_size,
+                  policy_size=state['policy_stack.4.weight'].shape[0])
+    model.load_state_dict(state)
+    model.eval()
+    return model, in_channels, grid_size
+
+
+def folded_layers(model):
+    tower = [fold(model.pb[i], model.pb[i + 1]) for i in range(0, len(model.pb), 3)]
+    policy_conv = fold(model.policy_stack[0], model.policy_stack[1])
+    value_conv = fold(model.value_stack[0], model.value_stack[1])
+    policy_dense = model.policy_stack[4]
+    value_hidden = model.value_stack[4]
+    value_output = model.value_stack[6]
+    return tower, policy_conv, policy_dense, value_conv, value_hidden, value_output
+
+
+def folded_forward(model, x):
+    """Forward pass using the folded weights, for checking the export."""
+    tower, policy_conv, policy_dense, value_conv, value_hidden, value_output = folded_layers(model)
+    for weight, bias in tower:
+        x = F.relu(F.conv2d(x, weight, bias, padding=1))
+    policy = F.relu(F.conv2d(x, *policy_conv)).flatten(1)
+    policy = F.softmax(policy_dense(policy), 1)
+    value = F.relu(F.conv2d(x, *value_conv)).flatten(1)
+    value = torch.tanh(value_output(F.relu(value_hidden(value))))
+    return policy, value
+
+
+def load_positions(directory, num_positions):
+    """Random sample of encoded positions from experience files."""
+    states = []
+    for path in glob.glob(os.path.join(directory, 'states*.json')):
+        with open(path, 'r') as f:
+            info = json.load(f)
+        states.append(np.memmap(os.path.join(directory, info['data']), dtype=info['dtype'],
+                                mode='r', shape=tuple(info['shape'])))
+    if not states:
+        raise click.ClickException(f'no experience files in {directory}')
+    total = sum(len(s) for s in states)
+    indices = np.sort(np.random.choice(total, min(num_positions, total), replace=False))
+    offsets = np.cumsum([0] + [len(s) for s in states])
+    chunks = [s[indices[(indices >= lo) & (indices < hi)] - lo]
+              for s, lo, hi in zip(states, offsets[:-1], offsets[1:])]
+    return torch.tensor(np.concatenate(chunks), dtype=torch.float32)
+
+
+def activation_ranges(tower, x, percentile, batch_size=256):
+    """Range of the input activations to each tower layer.
+
+    A high percentile rather than the maximum keeps rare outliers from
+    coarsening the quantization of every other activation.
+    """
+    inputs = [[] for _ in tower]
+    for batch in torch.split(x, batch_size):
+        for i, (weight, bias) in enumerate(tower):
+            inputs[i].append(batch.flatten())
+            batch = F.relu(F.conv2d(batch, weight, bias, padding=1))
+    return [float(np.percentile(torch.cat(values).numpy(), percentile)) for values in inputs]
+
+
+@click.command()
+@click.argument('network')
+@click.option('-o', '--output', required=True, help='output weights file')
+@click.option('-c', '--calibration-data', help='experience directory for int8 calibration')
+@click.option('-n', '--num-positions', default=2000, show_default=True,
+              help='number of positions used for calibration')
+@click.option('--percentile', default=99.99, show_default=True,
+              help='percentile of activations used as the quantization range')
+def main(network, output, calibration_data, num_positions, percentile):
+    with torch.no_grad():
+        model, in_channels, grid_size = load_model(network)
+        tower, policy_conv, policy_dense, value_conv, value_hidden, value_output = folded_layers(model)
+
+        x = torch.randint(0, 2, (16, in_channels, grid_size, grid_size)).float()
+        policy, value = model(x)
+        folded_policy, folded_value = folded_forward(model, x)
+        print('max folding error:', max((policy - folded_policy).abs().max().item(),
+                                        (value - folded_value).abs().max().item()))
+
+        header = [in_channels, grid_size, len(tower), tower[0][0].shape[0],
+                  policy_conv[0].shape[0], policy_dense.out_features,
+                  value_conv[0].shape[0], value_hidden.out_features]
+        tensors = [t for layer in tower for t in layer]
+        tensors += [*policy_conv, policy_dense.weight, policy_dense.bias,
+                    *value_conv, value_hidden.weight, value_hidden.bias,
+                    value_output.weight, value_output.bias]
+
+        ranges = None
+        if calibration_data:
+            positions = load_positions(calibration_data, num_positions)
+            ranges = activation_ranges(tower, positions, percentile)
+            print(f'calibrated on {len(positions)} positions, activation ranges:',
+                  ' '.join(f'{r:.3g}' for r in ranges))
+
+        with open(output, 'wb') as f:
+            f.write(MAGIC)
+            f.write(struct.pack('<8i', *header))
+            for t in tensors:
+                f.write(t.contiguous().numpy().astype('<f4').tobytes())
+            if ranges:
+                f.write(struct.pack('<i', len(ranges)))
+                f.write(np.array(ranges, dtype='<f4').tobytes())
+
+
+if __name__ == '__main__':
+    main()
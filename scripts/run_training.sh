@@ -8,7 +8,12 @@ RESULTS_DIR=results
 
 initial_version=0
 num_iterations=2
+# Worker and thread counts come from the autotune config when available;
+# otherwise these defaults are used.
 num_tasks=8
+num_threads=1
+thread_args="-t $num_threads"
+TUNING_CONFIG=$RESULTS_DIR/autotune.conf
 
 mkdir -p $RESULTS_DIR
 
@@ -17,6 +22,23 @@ if [ "$initial_version" -eq 0 ]; then
     python nn/nine/conv_4x64.py -o $RESULTS_DIR/v$MAJOR_VERSION.0
 fi
 
+# Measure inference throughput on this host once.  The network architecture
+# doesn't change between iterations, so the initial model is representative.
+if [ ! -f "$TUNING_CONFIG" ]; then
+    $BUILD_DIR/autotune $RESULTS_DIR/v$MAJOR_VERSION.$initial_version.ts -o $TUNING_CONFIG
+fi
+if [ -f "$TUNING_CONFIG" ]; then
+    num_tasks=$(sed -n 's/^num_workers=//p' $TUNING_CONFIG)
+    num_threads=$(sed -n 's/^num_threads=//p' $TUNING_CONFIG)
+    thread_args="--config $TUNING_CONFIG"
+fi
+# Evaluation runs as a single process that plays its games concurrently and
+# batches each network's evaluations, so it gets the threads of all tasks.
+eval_thread_args="-t $(( num_tasks * num_threads ))"
+if [ -f "$TUNING_CONFIG" ]; then
+    eval_thread_args="--config $TUNING_CONFIG $eval_thread_args"
+fi
+
 # Main iteration loop:
 for iter in $(seq $initial_version $(( num_iterations + $initial_version - 1 ))); do
     echo `date`
@@ -36,7 +58,7 @@ for iter in $(seq $initial_version $(( num_iterations + $initial_version - 1 )))
             $RESULTS_DIR/v$version.ts \
             -g 500 \
             -e 100 \
-            -t 1 \
+            $thread_args \
             -o $output_dir/experience \
             -l "$i" \
             > "$output_dir/sim_$i.out" &
@@ -57,15 +79,12 @@ for iter in $(seq $initial_version $(( num_iterations + $initial_version - 1 )))
            > "$output_dir/train.out"
 
     # Evaluation:
-    for i in $(seq $num_tasks); do
-        $BUILD_DIR/matchup \
-            $RESULTS_DIR/v$new_version.ts \
-            $RESULTS_DIR/v$version.ts \
-            -t 1 \
-            -g 25 \
-            > "$output_dir/eval_$i.out" &
-    done
-    wait
+    $BUILD_DIR/matchup \
+        $RESULTS_DIR/v$new_version.ts \
+        $RESULTS_DIR/v$version.ts \
+        $eval_thread_args \
+        -g 200 \
+        > "$output_dir/eval.out"
 
 done
 
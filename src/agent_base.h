@@ -1,11 +1,50 @@
 #ifndef AGENT_BASE_H
 #define AGENT_BASE_H
 
+#include <atomic>
+#include <functional>
+#include <optional>
+#include <vector>
+
 #include "goboard.h"
 
+/// Time to spend on a move, in seconds.  Search may stop at the target once
+/// the best move is settled, and stops at the maximum regardless.
+struct TimeBudget {
+  double target;
+  double maximum;
+};
+
+/// Search results for a root move, reported during analysis.
+struct MoveAnalysis {
+  Move move;
+  int visits;
+  // Expected value of the move for the player to move, in [-1, 1].
+  float value;
+  float prior;
+  // Principal variation, starting with the move.
+  std::vector<Move> pv;
+};
+
+using AnalysisCallback = std::function<void(const std::vector<MoveAnalysis>&)>;
+
 class Agent {
  public:
+  virtual ~Agent() = default;
   virtual Move select_move(const GameState&) = 0;
+  /// Limit the search time of subsequent moves, in place of the agent's
+  /// round limit.  Agents without a time-aware search ignore it.
+  virtual void set_time_budget(std::optional<TimeBudget>) {}
+  /// Search the position in the background until `stop` is set, so that the
+  /// next select_move can reuse the tree.  Agents that can't reuse their
+  /// search return immediately.
+  virtual void ponder(const GameState&, const std::atomic<bool>& stop) {}
+  /// Search the position until `stop` is set, calling `report` every
+  /// `interval` seconds with the visited root moves in order of decreasing
+  /// visits.  Only supported if supports_analysis() is true.
+  virtual void analyze(const GameState&, const std::atomic<bool>& stop,
+                       double interval, const AnalysisCallback& report) {}
+  virtual bool supports_analysis() const { return false; }
 };
 
 #endif // AGENT_BASE_H
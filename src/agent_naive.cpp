@@ -42,7 +42,7 @@ Move FastRandomBot::select_move(const GameState& game_state) {
   std::vector<size_t> point_indices;
   for (size_t i=0; i<point_cache.size(); ++i)
     point_indices.push_back(i);
-  std::shuffle(point_indices.begin(), point_indices.end(), rng);
+  std::shuffle(point_indices.begin(), point_indices.end(), engine ? *engine : rng);
   for (auto i : point_indices) {
     auto p = point_cache[i];
     if (game_state.is_valid_move(Move::play(p)) &&
@@ -1,6 +1,7 @@
 #ifndef AGENT_NAIVE_H
 #define AGENT_NAIVE_H
 
+#include <optional>
 #include <random>
 #include "agent_base.h"
 #include "agent_helpers.h"
@@ -15,8 +16,14 @@ public:
 
 class FastRandomBot : public Agent {
 public:
+  FastRandomBot() = default;
+  /// Use a random engine of the bot's own, so that bots can play in separate
+  /// threads.  Otherwise the shared engine is used.
+  explicit FastRandomBot(unsigned seed) : engine(std::default_random_engine(seed)) {}
+
   Move select_move(const GameState& game_state);
 private:
+  std::optional<std::default_random_engine> engine;
   std::pair<int, int> cached_dim = {0, 0};
   std::vector<Point> point_cache;
   void update_cache(std::pair<int, int> dim);
@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <cxxopts.hpp>
+
+#include "sgf.h"
+#include "utils.h"
+#include "gtp/gtp_board.h"
+#include "zero/agent_zero.h"
+#include "zero/batching_evaluator.h"
+#include "zero/model_loader.h"
+#include "zero/tuning.h"
+
+
+/// SGF files in a directory and its subdirectories, in sorted order.
+std::vector<std::filesystem::path> find_sgf_files(const std::string& directory) {
+  std::vector<std::filesystem::path> files;
+  for (const auto& entry : std::filesystem::recursive_directory_iterator(directory)) {
+    if (entry.is_regular_file() && lowercase(entry.path().extension().string()) == ".sgf")
+      files.push_back(entry.path());
+  }
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+
+/// Output line for the position before a move: the game, move number, player
+/// and move played, followed by the best move, its winrate for the player to
+/// move, and the visits of each searched move.
+std::string format_position(const std::string& game, int move_number, Player player, Move played,
+                            const std::vector<MoveAnalysis>& analysis) {
+  std::ostringstream ss;
+  ss << game << "\t" << move_number << "\t" << (player == Player::black ? "B" : "W") << "\t"
+     << move_to_gtp_vertex(played) << "\t";
+  if (analysis.empty()) {
+    ss << "-\t-\t";
+  }
+  else {
+    ss << move_to_gtp_vertex(analysis.front().move) << "\t" << std::fixed << std::setprecision(3)
+       << (1.0 + analysis.front().value) / 2 << "\t";
+  }
+  for (size_t i=0; i<analysis.size(); ++i) {
+    if (i > 0)
+      ss << " ";
+    ss << move_to_gtp_vertex(analysis[i].move) << ":" << analysis[i].visits;
+  }
+  ss << "\n";
+  return ss.str();
+}
+
+
+int main(int argc, const char* argv[]) {
+
+  cxxopts::Options options("analyze", "Analyze the positions of SGF game records with a zero agent");
+
+  options.add_options()
+    ("network", "Network file", cxxopts::value<std::string>())
+    ("directory", "Directory of SGF files, searched recursively", cxxopts::value<std::string>())
+    ("o,output", "Output file", cxxopts::value<std::string>()->default_value("analysis.tsv"))
+    ("r,rounds", "Number of rounds per position", cxxopts::value<int>()->default_value("800"))
+    ("b,board-size", "Board size (games of other sizes are skipped)", cxxopts::value<int>()->default_value("9"))
+    ("moves", "Move numbers to analyze the positions before (default: all)", cxxopts::value<std::vector<int>>())
+    ("w,workers", "Games searched concurrently (default: number of cores)", cxxopts::value<int>())
+    ("batch-size", "Largest evaluation batch shared by the workers (default: from config, or 16)",
+     cxxopts::value<int>())
+    ("batch-wait", "Milliseconds an evaluation waits for a fuller batch", cxxopts::value<double>()->default_value("1"))
+    ("t,num-threads", "Number of pytorch threads", cxxopts::value<int>())
+    ("config", "Tuning configuration from autotune (num-threads takes precedence)", cxxopts::value<std::string>())
+    ("s,symmetry-ensemble", "Average network evaluations over all 8 board symmetries")
+    ("quantized", "Use int8 inference (calibrated native networks only)")
+    ("h,help", "Print usage")
+    ;
+
+  options.parse_positional({"network", "directory"});
+  options.positional_help("<network_file> <sgf_directory>");
+
+  cxxopts::ParseResult args;
+  try {
+    args = options.parse(argc, argv);
+  }
+  catch (const cxxopts::exceptions::exception& e) {
+    std::cout << options.help() << std::endl;
+    exit(1);
+  }
+
+  if (args.count("help")) {
+    std::cout << options.help() << std::endl;
+    exit(0);
+  }
+
+  if (! args.count("network") || ! args.count("directory")) {
+    std::cout << options.help() << std::endl;
+    exit(1);
+  }
+
+  auto num_rounds = args["rounds"].as<int>();
+  auto board_size = args["board-size"].as<int>();
+  auto symmetry_ensemble = args.count("symmetry-ensemble") > 0;
+  std::set<int> selected_moves;
+  if (args.count("moves")) {
+    auto moves = args["moves"].as<std::vector<int>>();
+    selected_moves.insert(moves.begin(), moves.end());
+  }
+  const int num_workers = args.count("workers") ? args["workers"].as<int>() :
+    std::max(1u, std::thread::hardware_concurrency());
+
+  TuningConfig config;
+  if (args.count("config")) {
+    try {
+      config = TuningConfig::load(args["config"].as<std::string>());
+    }
+    catch (const std::runtime_error& e) {
+      std::cerr << e.what() << std::endl;
+      exit(1);
+    }
+  }
+  if (args.count("num-threads")) {
+    std::cout << "setting " << args["num-threads"].as<int>() << " pytorch threads" << std::endl;
+    at::set_num_threads(args["num-threads"].as<int>());
+  }
+  else if (args.count("config")) {
+    std::cout << "setting " << config.num_threads << " pytorch threads from config" << std::endl;
+    at::set_num_threads(config.num_threads);
+  }
+  auto batch_size = args.count("batch-size") ? args["batch-size"].as<int>() :
+    (args.count("config") ? config.batch_size : 16);
+
+  std::vector<std::filesystem::path> files;
+  try {
+    files = find_sgf_files(args["directory"].as<std::string>());
+  }
+  catch (const std::filesystem::filesystem_error& e) {
+    std::cerr << e.what() << std::endl;
+    return -1;
+  }
+  std::cout << "found " << files.size() << " SGF files" << std::endl;
+
+  auto encoder = std::make_shared<SimpleEncoder>(board_size);
+  ModelLoadOptions load_options;
+  load_options.warmup_batch_sizes = {batch_size};
+  load_options.quantized = args.count("quantized") > 0;
+  std::unique_ptr<BatchingEvaluator> batching_evaluator;
+  try {
+    auto evaluator = load_evaluator(args["network"].as<std::string>(), *encoder, load_options);
+    batching_evaluator = std::make_unique<BatchingEvaluator>(
+      evaluator, encoder->input_size(), encoder->num_moves(), batch_size,
+      args["batch-wait"].as<double>() / 1000);
+  }
+  catch (const std::runtime_error& e) {
+    std::cerr << e.what() << std::endl;
+    return -1;
+  }
+
+  auto output_path = args["output"].as<std::string>();
+  std::ofstream fout(output_path);
+  if (! fout) {
+    std::cerr << "unable to write " << output_path << std::endl;
+    return -1;
+  }
+  fout << "game\tmove\tplayer\tplayed\tbest\twinrate\tvisits\n";
+
+  // Each worker searches whole games, so that a game's lines are written
+  // together, while the workers' evaluations share batches.
+  std::atomic<size_t> next_game = 0;
+  std::mutex output_mutex;
+  int num_games_done = 0;
+  long num_positions = 0;
+  auto timer = Timer();
+  auto work = [&]() {
+    ZeroAgent agent(batching_evaluator->make_client(), encoder, num_rounds);
+    agent.set_symmetry_ensemble(symmetry_ensemble);
+    for (size_t g = next_game++; g < files.size(); g = next_game++) {
+      auto name = files[g].string();
+      std::string lines;
+      int game_positions = 0;
+      try {
+        auto game = load_sgf(name);
+        if (game.board_size != board_size)
+          throw std::runtime_error("board size " + std::to_string(game.board_size));
+        if (game.has_setup)
+          throw std::runtime_error("setup stones are not supported");
+        auto game_state = GameState::new_game(board_size, game.komi);
+        for (size_t i=0; i < game.moves.size() && ! game_state->is_over(); ++i) {
+          auto [player, move] = game.moves[i];
+          if (player != game_state->next_player || ! game_state->is_valid_move(move))
+            throw std::runtime_error("invalid move " + std::to_string(i + 1));
+          int move_number = i + 1;
+          if (selected_moves.empty() || selected_moves.count(move_number)) {
+            lines += format_position(name, move_number, player, move,
+                                     agent.analyze_position(*game_state));
+            ++game_positions;
+          }
+          game_state = game_state->apply_move(move);
+        }
+      }
+      catch (const std::runtime_error& e) {
+        std::lock_guard<std::mutex> lock(output_mutex);
+        std::cerr << "skipping " << name << ": " << e.what() << std::endl;
+        lines.clear();
+        game_positions = 0;
+      }
+
+      std::lock_guard<std::mutex> lock(output_mutex);
+      fout << lines;
+      ++num_games_done;
+      num_positions += game_positions;
+      auto elapsed = timer.elapsed();
+      auto remaining = (files.size() - num_games_done) * elapsed / num_games_done;
+      std::cout << num_games_done << "/" << files.size() << ", "
+                << std::setprecision(4) << num_positions / elapsed << " positions/s"
+                << "  [" << format_seconds(elapsed) << " < " << format_seconds(remaining) << "]"
+                << std::endl;
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (int w=0; w<num_workers; ++w)
+    workers.emplace_back(work);
+  for (auto& worker : workers)
+    worker.join();
+
+  std::cout << "Finished: " << num_positions << " positions, mean batch size "
+            << batching_evaluator->mean_batch_size() << std::endl;
+  std::cout << "Wrote " << output_path << std::endl;
+}
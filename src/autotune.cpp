@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <cxxopts.hpp>
+
+#include "utils.h"
+#include "zero/encoder.h"
+#include "zero/model_loader.h"
+#include "zero/tuning.h"
+
+
+struct Measurement {
+  int num_threads;
+  int num_workers;
+  int batch_size;
+  double evals_per_second;
+  // Latency of a single batch, in milliseconds.
+  double p50, p90, p99;
+};
+
+
+/// Powers of two up to max_value, including max_value itself.
+std::vector<int> powers_of_two(int max_value) {
+  std::vector<int> values;
+  for (int v=1; v < max_value; v *= 2)
+    values.push_back(v);
+  values.push_back(max_value);
+  return values;
+}
+
+
+/// Run the evaluators concurrently, one per worker thread, for the given
+/// duration.  Each worker sets its own intra-op thread count, as separate
+/// processes would.
+Measurement measure(std::vector<std::shared_ptr<Evaluator>>& evaluators,
+                    const Encoder& encoder, const std::vector<float>& inputs,
+                    int num_threads, int num_workers, int batch_size, double duration) {
+  std::vector<std::vector<double>> latencies(num_workers);
+  std::vector<std::thread> workers;
+  auto timer = Timer();
+  for (int w=0; w<num_workers; ++w) {
+    workers.emplace_back([&, w]() {
+      at::set_num_threads(num_threads);
+      std::vector<float> priors(batch_size * encoder.num_moves());
+      std::vector<float> values(batch_size);
+      auto worker_timer = Timer();
+      while (worker_timer.elapsed() < duration) {
+        auto batch_timer = Timer();
+        evaluators[w]->evaluate(inputs.data(), batch_size, priors.data(), values.data());
+        latencies[w].push_back(1000 * batch_timer.elapsed());
+      }
+    });
+  }
+  for (auto& worker : workers)
+    worker.join();
+  auto elapsed = timer.elapsed();
+
+  std::vector<double> all;
+  for (const auto& l : latencies)
+    all.insert(all.end(), l.begin(), l.end());
+  std::sort(all.begin(), all.end());
+  auto percentile = [&](double p) { return all[static_cast<size_t>(p * (all.size() - 1))]; };
+  return {num_threads, num_workers, batch_size,
+          all.size() * batch_size / elapsed,
+          percentile(0.5), percentile(0.9), percentile(0.99)};
+}
+
+
+int main(int argc, const char* argv[]) {
+
+  cxxopts::Options options("autotune", "Measure inference throughput and recommend settings for this host");
+
+  options.add_options()
+    ("network", "Network file", cxxopts::value<std::string>())
+    ("o,output", "Configuration file to write", cxxopts::value<std::string>()->default_value("autotune.conf"))
+    ("b,board-size", "Board size", cxxopts::value<int>()->default_value("9"))
+    ("batch-sizes", "Batch sizes to measure", cxxopts::value<std::vector<int>>()->default_value("1,2,4,8,16,32"))
+    ("threads", "Intra-op thread counts to measure (default: powers of 2 up to the number of cores)",
+     cxxopts::value<std::vector<int>>())
+    ("workers", "Concurrent worker counts to measure (default: powers of 2 up to the number of cores)",
+     cxxopts::value<std::vector<int>>())
+    ("d,duration", "Seconds to measure each configuration", cxxopts::value<double>()->default_value("2"))
+    ("h,help", "Print usage")
+    ;
+
+  options.parse_positional({"network"});
+  options.positional_help("<network_file>");
+
+  cxxopts::ParseResult args;
+  try {
+    args = options.parse(argc, argv);
+  }
+  catch (const cxxopts::exceptions::exception& e) {
+    std::cout << options.help() << std::endl;
+    exit(1);
+  }
+
+  if (args.count("help")) {
+    std::cout << options.help() << std::endl;
+    exit(0);
+  }
+
+  if (! args.count("network")) {
+    std::cout << options.help() << std::endl;
+    exit(1);
+  }
+
+  auto network_path = args["network"].as<std::string>();
+  auto output_path = args["output"].as<std::string>();
+  auto duration = args["duration"].as<double>();
+  auto batch_sizes = args["batch-sizes"].as<std::vector<int>>();
+  const int num_cores = std::max(1u, std::thread::hardware_concurrency());
+  auto thread_counts = args.count("threads") ? args["threads"].as<std::vector<int>>() : powers_of_two(num_cores);
+  auto worker_counts = args.count("workers") ? args["workers"].as<std::vector<int>>() : powers_of_two(num_cores);
+  if (duration <= 0) {
+    std::cerr << "duration must be positive" << std::endl;
+    return -1;
+  }
+  if (batch_sizes.empty() || *std::min_element(batch_sizes.begin(), batch_sizes.end()) < 1) {
+    std::cerr << "batch sizes must be positive" << std::endl;
+    return -1;
+  }
+  // Measured in ascending order, which the choice of batch size relies on.
+  std::sort(batch_sizes.begin(), batch_sizes.end());
+  batch_sizes.erase(std::unique(batch_sizes.begin(), batch_sizes.end()), batch_sizes.end());
+
+  SimpleEncoder encoder(args["board-size"].as<int>());
+
+  // One evaluator per worker, warmed up at every batch size.
+  ModelLoadOptions load_options;
+  load_options.warmup_batch_sizes = batch_sizes;
+  std::vector<std::shared_ptr<Evaluator>> evaluators;
+  try {
+    for (int w=0; w < *std::max_element(worker_counts.begin(), worker_counts.end()); ++w)
+      evaluators.push_back(load_evaluator(network_path, encoder, load_options));
+  }
+  catch (const std::runtime_error& e) {
+    std::cerr << e.what() << std::endl;
+    return -1;
+  }
+
+  // Random binary planes, roughly like encoded positions.
+  std::mt19937 gen(0);
+  std::bernoulli_distribution plane_dist(0.2);
+  std::vector<float> inputs(*std::max_element(batch_sizes.begin(), batch_sizes.end()) * encoder.input_size());
+  for (auto& x : inputs)
+    x = plane_dist(gen);
+
+  std::cout << "threads workers  batch    evals/s   p50 ms   p90 ms   p99 ms" << std::endl;
+  std::vector<Measurement> results;
+  for (auto num_threads : thread_counts) {
+    for (auto num_workers : worker_counts) {
+      // Oversubscribed configurations are never faster.
+      if (num_threads * num_workers > num_cores)
+        continue;
+      for (auto batch_size : batch_sizes) {
+        auto m = measure(evaluators, encoder, inputs, num_threads, num_workers, batch_size, duration);
+        results.push_back(m);
+        std::cout << std::setw(7) << m.num_threads << std::setw(8) << m.num_workers
+                  << std::setw(7) << m.batch_size << std::fixed << std::setprecision(1)
+                  << std::setw(11) << m.evals_per_second << std::setprecision(3)
+                  << std::setw(9) << m.p50 << std::setw(9) << m.p90 << std::setw(9) << m.p99
+                  << std::defaultfloat << std::endl;
+      }
+    }
+  }
+
+  // Self-play evaluates one position at a time, so threads and workers are
+  // chosen for the best throughput at batch size 1 (or the smallest batch
+  // measured).
+  auto smallest_batch = batch_sizes.front();
+  const Measurement* best = nullptr;
+  for (const auto& m : results) {
+    if (m.batch_size == smallest_batch && (! best || m.evals_per_second > best->evals_per_second))
+      best = &m;
+  }
+  if (! best) {
+    std::cerr << "no configurations fit within " << num_cores << " cores" << std::endl;
+    return -1;
+  }
+
+  // For batching evaluators, the smallest batch that comes within 10% of the
+  // best single-worker throughput at that thread count, to limit latency.
+  double best_batched = 0.0;
+  for (const auto& m : results) {
+    if (m.num_threads == best->num_threads && m.num_workers == 1)
+      best_batched = std::max(best_batched, m.evals_per_second);
+  }
+  TuningConfig config;
+  config.num_threads = best->num_threads;
+  config.num_workers = best->num_workers;
+  config.batch_size = smallest_batch;
+  for (const auto& m : results) {
+    if (m.num_threads == best->num_threads && m.num_workers == 1 &&
+        m.evals_per_second >= 0.9 * best_batched) {
+      config.batch_size = m.batch_size;
+      break;
+    }
+  }
+
+  std::ostringstream comment;
+  comment << "Written by autotune for " << network_path << " on " << num_cores << " cores\n";
+  comment << std::fixed << std::setprecision(1) << best->evals_per_second
+          << " evals/s in total at batch size " << best->batch_size;
+  config.save(output_path, comment.str());
+
+  std::cout << "Recommended: " << config.num_threads << " threads, " << config.num_workers
+            << " workers, batch size " << config.batch_size << std::endl;
+  std::cout << "Wrote " << output_path << std::endl;
+}
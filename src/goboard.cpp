@@ -53,6 +53,7 @@ std::ostream& operator<<(std::ostream& os, const Board& b) {
 
 std::map<std::pair<int,int>,
          std::unordered_map<Point, std::vector<Point>, PointHash>> Board::neighbor_tables = {};
+std::mutex Board::neighbor_tables_mutex;
 
 void Board::init_neighbor_table(std::pair<int,int> dim) {
   auto [rows, cols] = dim;
@@ -109,8 +110,7 @@ void Board::place_stone(Player player, const Point& point) {
     // std::cout << "merging new string with same color with " << same_color_string->stones.size() << " stones\n";
     new_string = new_string->merged_with(*same_color_string);
   }
-  for (const auto &new_string_point : new_string->stones)
-    grid[new_string_point] = new_string;
+  replace_string(new_string);
 
   hash ^= hasher.point_keys[size_t(player)][point.row-1][point.col-1];
   // std::cout << "  Hash place << " << int(player) << " " << point.row << " " << point.col << " " << hasher.point_keys[size_t(player)][point.row-1][point.col-1] << " " << hash << std::endl;
@@ -130,8 +130,10 @@ void Board::place_stone(Player player, const Point& point) {
 
 
 void Board::replace_string(std::shared_ptr<GoString> new_string) {
-  for (const auto& point : new_string->stones)
+  for (const auto& point : new_string->stones) {
     grid[point] = new_string;
+    update_liberty_plane(point, *new_string);
+  }
 }
 
 
@@ -145,6 +147,7 @@ void Board::remove_string(std::shared_ptr<GoString> string) {
         replace_string(neighbor_string_it->second->with_liberty(point));
     }
     grid.erase(point);
+    liberty_planes[(point.row - 1) * num_cols + point.col - 1] = 0;
     hash ^= hasher.point_keys[size_t(string->color)][point.row-1][point.col-1];
     // std::cout << "  Hash remove << " << int(string->color) << " " << point.row << " " << point.col << " " << hasher.point_keys[size_t(string->color)][point.row-1][point.col-1] << " " << hash << std::endl;
   }
@@ -247,6 +250,34 @@ bool GameState::is_valid_move(Move m) const {
 }
 
 
+std::vector<Point> GameState::ko_points() const {
+  std::vector<Point> points;
+  const auto& liberty_planes = board->get_liberty_planes();
+  const auto num_rows = board->num_rows;
+  const auto num_cols = board->num_cols;
+  // Opponent stones in atari; only moves next to them can capture, and hence
+  // only those can violate ko.
+  const uint8_t opponent_atari = next_player == Player::white ? 1 : 5;
+  auto is_opponent_atari = [&] (int offset) {
+    return liberty_planes[offset] == opponent_atari;
+  };
+
+  for (auto offset=0; offset<num_rows * num_cols; ++offset) {
+    if (liberty_planes[offset])
+      continue;
+    auto i = offset / num_cols;
+    auto j = offset % num_cols;
+    bool can_capture = (i > 0 && is_opponent_atari(offset - num_cols)) ||
+      (i + 1 < num_rows && is_opponent_atari(offset + num_cols)) ||
+      (j > 0 && is_opponent_atari(offset - 1)) ||
+      (j + 1 < num_cols && is_opponent_atari(offset + 1));
+    if (can_capture && does_move_violate_ko(next_player, Move::play(Point(i+1, j+1))))
+      points.emplace_back(i+1, j+1);
+  }
+  return points;
+}
+
+
 std::vector<Move> GameState::legal_moves() const {
   std::vector<Move> moves;
   for (auto r=1; r <= board->num_rows; r++) {
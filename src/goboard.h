@@ -7,6 +7,9 @@
 #include <map>
 #include <optional>
 #include <memory>
+#include <mutex>
+#include <vector>
+#include <cstdint>
 #include <iostream>
 #include <utility> // Pair
 #include <algorithm> // std::find
@@ -105,20 +108,33 @@ private:
   uint64_t hash;
   static std::map<std::pair<int,int>,
                             std::unordered_map<Point, std::vector<Point>, PointHash>> neighbor_tables;
+  // Guards neighbor_tables, since games on several threads may start at once.
+  static std::mutex neighbor_tables_mutex;
   static void init_neighbor_table(std::pair<int,int>);
   std::unordered_map<Point, std::vector<Point>, PointHash>* neighbor_table_ptr;
+  // For each point (row-major), 0 if empty, otherwise 1 + the encoder feature
+  // plane of the stone when black is to move: 1-4 for black stones with 1, 2,
+  // 3, 4+ liberties, and 5-8 for white stones.  Maintained as stones are
+  // placed and captured so that encoding doesn't need to visit the strings.
+  std::vector<uint8_t> liberty_planes;
 public:
   int num_rows, num_cols;
   GridMap grid;
 
   Board(int num_rows, int num_cols, GridMap grid = {}, uint64_t hash = 0)
-    : num_rows{num_rows}, num_cols{num_cols}, grid(grid), hash(hash) {
+    : num_rows{num_rows}, num_cols{num_cols}, grid(grid), hash(hash),
+      liberty_planes(num_rows * num_cols, 0) {
     assert(num_rows <= HASH_MAX_BOARD && num_cols <= HASH_MAX_BOARD);
     // std::cout << "in board, hash: " << hasher.point_keys[0][0][0] << "\n";
     auto dim = std::make_pair(num_rows, num_cols);
-    if (neighbor_tables.find(dim) == neighbor_tables.end())
-      init_neighbor_table(dim);
-    neighbor_table_ptr = &(neighbor_tables.find(dim)->second);
+    {
+      std::lock_guard<std::mutex> lock(neighbor_tables_mutex);
+      if (neighbor_tables.find(dim) == neighbor_tables.end())
+        init_neighbor_table(dim);
+      neighbor_table_ptr = &(neighbor_tables.find(dim)->second);
+    }
+    for (const auto& [point, string] : this->grid)
+      update_liberty_plane(point, *string);
   }
 
   friend std::ostream& operator<<(std::ostream&, const Board& b);
@@ -127,7 +143,7 @@ public:
   // deep copies.  Current implementation uses immutable sets inside the grid
   // map, so we don't actually need to deep copy the grid.
   BoardPtr deepcopy() {
-    return std::make_shared<Board>(num_rows, num_cols, grid, hash);
+    return std::make_shared<Board>(*this);
   }
 
   bool is_on_grid(const Point& point) const {
@@ -155,6 +171,9 @@ public:
 
   uint64_t get_hash() const { return hash; }
 
+  /// Row-major liberty plane for each point; see liberty_planes.
+  const std::vector<uint8_t>& get_liberty_planes() const { return liberty_planes; }
+
   bool is_self_capture(Player, Point);
   bool will_capture(Player, Point);
 
@@ -162,6 +181,11 @@ public:
   void replace_string(std::shared_ptr<GoString> string);
   void remove_string(std::shared_ptr<GoString> string);
 
+  void update_liberty_plane(const Point& point, const GoString& string) {
+    auto plane = std::min(4, string.num_liberties()) + (string.color == Player::white ? 4 : 0);
+    liberty_planes[(point.row - 1) * num_cols + point.col - 1] = plane;
+  }
+
 };
 
 class GameState : public std::enable_shared_from_this<GameState> {
@@ -203,6 +227,13 @@ public:
 
   bool is_valid_move(Move m) const;
 
+  /// Empty points where a move by the next player would violate ko.
+  std::vector<Point> ko_points() const;
+
+  bool is_last_move_pass() const {
+    return last_move && last_move.value().is_pass;
+  }
+
   std::vector<Move> legal_moves() const;
 
 };
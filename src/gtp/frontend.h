@@ -1,18 +1,25 @@
 #ifndef GTP_FRONTEND_H
 #define GTP_FRONTEND_H
 
+#include <atomic>
+#include <cctype>
 #include <iostream>
 #include <memory>
+#include <optional>
 #include <unordered_map>
 #include <deque>
 #include <sstream>
+#include <stdexcept>
+#include <thread>
 
 #include "../goboard.h"
 #include "../utils.h"
 #include "command.h"
 #include "response.h"
 #include "gtp_board.h"
+#include "time_control.h"
 #include "../agent_base.h"
+#include "../ownership.h"
 #include "../scoring.h"
 
 
@@ -26,10 +33,36 @@ namespace gtp {
     int boardsize = 19;
     std::unique_ptr<Agent> agent;
 
-    std::istream& input = std::cin;
-    std::ostream& output = std::cout;
+    std::istream& input;
+    std::ostream& output;
     GameStatePtr game_state = GameState::new_game(19);
     float komi = 7.5;
+    // Clocks for black and white.
+    GameClock clocks[2];
+
+    // Background search, for pondering or analysis, runs while the next
+    // command is read and is stopped before the command is processed.  If
+    // pondering, the agent searches the current position between commands.
+    bool pondering = false;
+    std::thread search_thread;
+    std::atomic<bool> stop_search = false;
+
+    // Analysis requested by the last command, and whether an analysis response
+    // is being streamed.  The next command ends the stream.
+    struct AnalysisRequest {
+      double interval;
+      bool kata_format;
+    };
+    std::optional<AnalysisRequest> analysis_request;
+    bool analyzing = false;
+    constexpr static double DEFAULT_ANALYSIS_INTERVAL = 1.0;
+    constexpr static double MIN_ANALYSIS_INTERVAL = 0.01;
+
+    // Dead stones for scoring are found from random playouts, shared by
+    // final_score and final_status_list until the position changes.
+    std::optional<OwnershipEstimate> ownership;
+    ConstGameStatePtr ownership_state;
+    constexpr static int NUM_OWNERSHIP_PLAYOUTS = 1000;
 
     std::unordered_map<std::string, Response (GTPFrontend::*)(const ArgList&)> handlers = {
       {"name", &GTPFrontend::handle_name},
@@ -44,34 +77,108 @@ namespace gtp {
       {"genmove", &GTPFrontend::handle_genmove},
       {"komi", &GTPFrontend::handle_komi},
       {"final_score", &GTPFrontend::handle_final_score},
-      {"time_settings", &GTPFrontend::ignore},
-      {"time_left", &GTPFrontend::ignore},
+      {"final_status_list", &GTPFrontend::handle_final_status_list},
+      {"time_settings", &GTPFrontend::handle_time_settings},
+      {"kgs-time_settings", &GTPFrontend::handle_kgs_time_settings},
+      {"time_left", &GTPFrontend::handle_time_left},
+      {"lz-analyze", &GTPFrontend::handle_lz_analyze},
+      {"kata-analyze", &GTPFrontend::handle_kata_analyze},
       {"quit", &GTPFrontend::handle_quit},
     };
 
   public:
 
-  GTPFrontend(std::unique_ptr<Agent> agent) : agent(std::move(agent)) {}
+  GTPFrontend(std::unique_ptr<Agent> agent, bool ponder = false,
+              std::istream& input = std::cin, std::ostream& output = std::cout) :
+    agent(std::move(agent)), input(input), output(output), pondering(ponder) {}
     /* GTPFrontend(const GTPFrontend&) = delete; */
     /* GTPFrontend& operator=(const GTPFrontend&) = delete; */
-    /* ~GTPFrontend() = default; */
+    ~GTPFrontend() { stop_search_thread(); }
 
     void run() {
       std::string line;
       while (! stopped) {
-        getline(input, line);
+        if (analysis_request)
+          start_analysis();
+        else
+          start_pondering();
+        if (! getline(input, line))
+          break;
         if (line.find_first_not_of(" \n") == std::string::npos)
           // Skip blank lines
           continue;
+        stop_search_thread();
+        if (analyzing) {
+          // A blank line ends the streamed response.
+          output << "\n" << std::flush;
+          analyzing = false;
+        }
         auto command = parse_command(line);
         auto response = process(command);
         output << response.serialize(command);
         output << std::flush;
       }
+      stop_search_thread();
     }
 
   private:
 
+    void start_pondering() {
+      // Nothing is pondered before the first move, since the board size may
+      // not have been set yet.
+      if (! pondering || search_thread.joinable() || game_state->num_moves == 0 ||
+          game_state->is_over())
+        return;
+      stop_search = false;
+      search_thread = std::thread([this, state = game_state]() {
+        agent->ponder(*state, stop_search);
+      });
+    }
+
+    void start_analysis() {
+      auto request = analysis_request.value();
+      analysis_request.reset();
+      analyzing = true;
+      stop_search = false;
+      search_thread = std::thread([this, request, state = game_state]() {
+        agent->analyze(*state, stop_search, request.interval,
+                       [&](const std::vector<MoveAnalysis>& moves) {
+                         // An empty line would end the response.
+                         if (! moves.empty())
+                           output << format_analysis(moves, request.kata_format) << std::endl;
+                       });
+      });
+    }
+
+    void stop_search_thread() {
+      if (search_thread.joinable()) {
+        stop_search = true;
+        search_thread.join();
+      }
+    }
+
+    /// One line of analysis with an info entry per move.  Leela Zero reports
+    /// winrate and prior in units of 0.01%, and KataGo as fractions.
+    static std::string format_analysis(const std::vector<MoveAnalysis>& moves, bool kata_format) {
+      std::stringstream ss;
+      for (size_t i=0; i<moves.size(); ++i) {
+        const auto& m = moves[i];
+        auto winrate = (1.0 + m.value) / 2;
+        if (i > 0)
+          ss << " ";
+        ss << "info move " << move_to_gtp_vertex(m.move) << " visits " << m.visits;
+        if (kata_format)
+          ss << " winrate " << winrate << " prior " << m.prior;
+        else
+          ss << " winrate " << static_cast<int>(10000 * winrate)
+             << " prior " << static_cast<int>(10000 * m.prior);
+        ss << " order " << i << " pv";
+        for (const auto& move : m.pv)
+          ss << " " << move_to_gtp_vertex(move);
+      }
+      return ss.str();
+    }
+
     Response process(Command cmd) {
       Response (GTPFrontend::*handler)(const ArgList&);
       auto it = handlers.find(cmd.name);
@@ -79,7 +186,17 @@ namespace gtp {
         handler = it->second;
       else
         handler = &GTPFrontend::handle_unknown;
-      return (this->*handler)(cmd.args);
+      // Numeric arguments are converted with std::stoi and friends, which
+      // throw on malformed input.
+      try {
+        return (this->*handler)(cmd.args);
+      }
+      catch (const std::invalid_argument&) {
+        return Response::error("syntax error");
+      }
+      catch (const std::out_of_range&) {
+        return Response::error("syntax error");
+      }
     }
 
     /* Command handlers: */
@@ -94,6 +211,8 @@ namespace gtp {
 
     Response handle_clear_board(const ArgList& args) {
       game_state = GameState::new_game(boardsize, komi);
+      for (auto& clock : clocks)
+        clock = GameClock(clock.get_settings());
       return Response::success();
     }
 
@@ -149,14 +268,13 @@ namespace gtp {
 
 
     Response handle_genmove(const ArgList& args) {
+      auto timer = Timer();
+      auto& clock = player_clock(args[0]);
+      agent->set_time_budget(clock.budget(game_state->board->num_rows, game_state->num_moves));
       auto move = agent->select_move(*game_state);
+      clock.record_move(timer.elapsed());
       game_state = game_state->apply_move(move);
-      if (move.is_pass)
-        return Response::success("pass");
-      else if (move.is_resign)
-        return Response::success("resign");
-      else
-        return Response::success(coords_to_gtp_position(move));
+      return Response::success(move_to_gtp_vertex(move));
     }
 
     Response handle_komi(const ArgList& args) {
@@ -165,8 +283,17 @@ namespace gtp {
       return Response::success();
     }
 
+    const OwnershipEstimate& estimate_ownership() {
+      if (! ownership || ownership_state != game_state) {
+        ownership.emplace(*game_state, NUM_OWNERSHIP_PLAYOUTS,
+                          std::max(1u, std::thread::hardware_concurrency()));
+        ownership_state = game_state;
+      }
+      return *ownership;
+    }
+
     Response handle_final_score(const ArgList& args) {
-      auto result = GameResult(game_state->board, komi);
+      auto result = estimate_ownership().score(komi);
       std::stringstream ss;
       ss << (result.winner() == Player::black ? "B" : "W");
       ss << "+";
@@ -174,6 +301,103 @@ namespace gtp {
       return Response::success(ss.str());
     }
 
+    /// Dead or alive strings, one per line.  Seki isn't detected, so its list
+    /// is empty.
+    Response handle_final_status_list(const ArgList& args) {
+      auto status = lowercase(args[0]);
+      if (status == "seki")
+        return Response::success();
+      if (status != "dead" && status != "alive")
+        return Response::error("unknown status");
+      auto strings = status == "dead" ? estimate_ownership().dead_strings() :
+        estimate_ownership().live_strings();
+      std::stringstream ss;
+      for (size_t i=0; i<strings.size(); ++i) {
+        if (i > 0)
+          ss << "\n";
+        for (size_t j=0; j<strings[i].size(); ++j)
+          ss << (j > 0 ? " " : "") << coords_to_gtp_position(Move::play(strings[i][j]));
+      }
+      return Response::success(ss.str());
+    }
+
+    Response handle_time_settings(const ArgList& args) {
+      if (args.size() < 3)
+        return Response::error("syntax error");
+      auto settings = TimeSettings::from_gtp(std::stod(args[0]), std::stod(args[1]), std::stoi(args[2]));
+      clocks[0] = clocks[1] = GameClock(settings);
+      return Response::success();
+    }
+
+    Response handle_kgs_time_settings(const ArgList& args) {
+      if (args.empty())
+        return Response::error("syntax error");
+      TimeSettings settings;
+      auto system = lowercase(args[0]);
+      if (system == "absolute") {
+        if (args.size() < 2)
+          return Response::error("syntax error");
+        settings.system = TimeSettings::System::absolute;
+        settings.main_time = std::stod(args[1]);
+      }
+      else if (system == "byoyomi" || system == "canadian") {
+        if (args.size() < 4)
+          return Response::error("syntax error");
+        settings.system = system == "byoyomi" ? TimeSettings::System::byo_yomi :
+          TimeSettings::System::canadian;
+        settings.main_time = std::stod(args[1]);
+        settings.period_time = std::stod(args[2]);
+        settings.period_stones = std::stoi(args[3]);
+      }
+      else if (system != "none")
+        return Response::error("unknown time system");
+      clocks[0] = clocks[1] = GameClock(settings);
+      return Response::success();
+    }
+
+    Response handle_time_left(const ArgList& args) {
+      if (args.size() < 3)
+        return Response::error("syntax error");
+      player_clock(args[0]).set_time_left(std::stod(args[1]), std::stoi(args[2]));
+      return Response::success();
+    }
+
+    Response handle_lz_analyze(const ArgList& args) {
+      return analysis_response(args, false);
+    }
+
+    Response handle_kata_analyze(const ArgList& args) {
+      return analysis_response(args, true);
+    }
+
+    /// Start streaming analysis of the current position.  Arguments are an
+    /// optional color, which is ignored, and the interval in centiseconds,
+    /// either alone or after the "interval" key.  Other key-value pairs are
+    /// ignored.
+    Response analysis_response(const ArgList& args, bool kata_format) {
+      if (! agent->supports_analysis())
+        return Response::error("analysis not supported by this agent");
+      double interval = DEFAULT_ANALYSIS_INTERVAL;
+      for (size_t i=0; i<args.size(); ++i) {
+        auto arg = lowercase(args[i]);
+        if (arg == "b" || arg == "w" || arg == "black" || arg == "white")
+          continue;
+        if (arg == "interval" && i + 1 < args.size())
+          interval = std::stod(args[++i]) / 100;
+        else if (std::isdigit(arg[0]))
+          interval = std::stod(arg) / 100;
+        else
+          ++i;
+      }
+      analysis_request = AnalysisRequest{std::max(interval, MIN_ANALYSIS_INTERVAL), kata_format};
+      return Response::stream();
+    }
+
+    GameClock& player_clock(const std::string& color) {
+      auto c = lowercase(color);
+      return clocks[c == "w" || c == "white" ? 1 : 0];
+    }
+
     Response handle_protocol_version(const ArgList& args) {
       return Response::success("2");
     }
@@ -21,3 +21,11 @@ Move gtp_position_to_move(const std::string& s) {
       static_cast<int>(COLS.find(std::toupper(col_str))) + 1});
   return Move::play(point);
 }
+
+std::string move_to_gtp_vertex(Move m) {
+  if (m.is_pass)
+    return "pass";
+  if (m.is_resign)
+    return "resign";
+  return coords_to_gtp_position(m);
+}
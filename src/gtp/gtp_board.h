@@ -6,6 +6,8 @@
 
 std::string coords_to_gtp_position(Move);
 Move gtp_position_to_move(const std::string&);
+/// GTP vertex for a move, including pass and resign.
+std::string move_to_gtp_vertex(Move);
 
 
 #endif // GTP_BOARD_H
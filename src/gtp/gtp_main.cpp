@@ -1,55 +1,94 @@
+#include <atomic>
+#include <functional>
 #include <memory>
 #include <iostream>
 
 #include <cxxopts.hpp>
 
 #include "frontend.h"
+#include "server.h"
 #include "../agent_naive.h"
 #include "../zero/agent_zero.h"
+#include "../zero/batching_evaluator.h"
+#include "../zero/model_loader.h"
+#include "../zero/tuning.h"
 #include "../alphabeta.h"
 #include "../eval.h"
 #include "../mcts.h"
 
 
-// Todo: move these to a shared file, they are also used by matchup
+std::unique_ptr<Agent> make_zero_agent(std::shared_ptr<Evaluator> evaluator,
+                                       int board_size,
+                                       int num_rounds,
+                                       bool symmetry_ensemble,
+                                       bool gumbel,
+                                       std::shared_ptr<NodeBudget> node_budget,
+                                       bool tree_reuse) {
+  auto encoder = std::make_shared<SimpleEncoder>(board_size);
+  auto agent = std::make_unique<ZeroAgent>(evaluator, encoder, num_rounds, true);
+  agent->set_symmetry_ensemble(symmetry_ensemble);
+  agent->set_gumbel(gumbel);
+  agent->set_node_budget(node_budget);
+  agent->set_tree_reuse(tree_reuse);
+  return agent;
+}
+
+
 std::unique_ptr<Agent> load_zero_agent(const std::string network_path,
                                        int board_size,
-                                       int num_rounds) {
-  c10::InferenceMode guard;
-  torch::jit::script::Module model;
+                                       int num_rounds,
+                                       bool symmetry_ensemble,
+                                       bool gumbel,
+                                       const ModelLoadOptions& load_options,
+                                       std::shared_ptr<NodeBudget> node_budget,
+                                       bool tree_reuse) {
+  auto encoder = std::make_shared<SimpleEncoder>(board_size);
+  std::shared_ptr<Evaluator> evaluator;
+
+  // Loading includes warmup, so that the first genmove of an engine started
+  // for a single game doesn't pay for TorchScript optimization.
   try {
-    model = torch::jit::load(network_path);
+    evaluator = load_evaluator(network_path, *encoder, load_options);
   }
-  catch (const c10::Error& e) {
-    std::cerr << "Error loading model: " << network_path << std::endl;
+  catch (const std::runtime_error& e) {
+    std::cerr << e.what() << std::endl;
     // Return emptpy pointer
     return std::unique_ptr<Agent>();
   }
 
-  std::cerr << "Loaded: " << network_path << std::endl;
-
-  auto encoder = std::make_shared<SimpleEncoder>(board_size);
-  auto agent = std::make_unique<ZeroAgent>(model, encoder, num_rounds, true);
-  return agent;
+  return make_zero_agent(evaluator, board_size, num_rounds, symmetry_ensemble, gumbel, node_budget,
+                         tree_reuse);
 }
 
 
 std::unique_ptr<Agent> load_agent(const std::string identifier,
                                        int board_size,
-                                       int num_rounds) {
+                                       int num_rounds,
+                                       bool symmetry_ensemble,
+                                       bool gumbel,
+                                       const ModelLoadOptions& load_options,
+                                       std::shared_ptr<NodeBudget> node_budget,
+                                       bool tree_reuse) {
   if (identifier == "random") {
     std::cerr << "loading random agent" << std::endl;
     return std::make_unique<FastRandomBot>();
   }
   else if (identifier == "mcts") {
     std::cerr << "loading mcts agent with " << num_rounds << " rounds" << std::endl;
-    return std::make_unique<MCTSAgent>(num_rounds, 1.5);
+    auto agent = std::make_unique<MCTSAgent>(num_rounds, 1.5);
+    agent->set_node_budget(node_budget);
+    return agent;
   }
   // auto frontend = gtp::GTPFrontend(std::make_unique<AlphaBetaAgent>(2, &capture_diff));
   else
-    return load_zero_agent(identifier, board_size, num_rounds);
+    return load_zero_agent(identifier, board_size, num_rounds, symmetry_ensemble, gumbel, load_options,
+                           node_budget, tree_reuse);
 }
 
+// Default node limit while pondering, since pondering otherwise searches
+// without bound during the opponent's turn.
+constexpr long PONDER_MAX_NODES = 200000;
+
 int main(int argc, const char* argv[]) {
 
   cxxopts::Options options("dlgobot", "Run engine using GTP");
@@ -58,6 +97,18 @@ int main(int argc, const char* argv[]) {
     ("agent", "Agent identifier or network file", cxxopts::value<std::string>()->default_value("mcts"))
     ("r,rounds", "Number of rounds", cxxopts::value<int>()->default_value("800"))
     ("t,num-threads", "Number of pytorch threads", cxxopts::value<int>())
+    ("config", "Tuning configuration from autotune (num-threads takes precedence)", cxxopts::value<std::string>())
+    ("s,symmetry-ensemble", "Average network evaluations over all 8 board symmetries")
+    ("gumbel", "Use Gumbel AlphaZero root search, suited to small numbers of rounds")
+    ("quantized", "Use int8 inference (calibrated native networks only)")
+    ("save-optimized", "Save the frozen TorchScript module for faster startup", cxxopts::value<std::string>())
+    ("max-nodes", "Limit the search tree size, pruning the least visited subtrees", cxxopts::value<long>())
+    ("ponder", "Search during the opponent's turn and reuse the tree (zero agents only)")
+    ("listen", "Serve GTP sessions on a local TCP port instead of stdin", cxxopts::value<int>())
+    ("socket", "Serve GTP sessions on a Unix-domain socket instead of stdin", cxxopts::value<std::string>())
+    ("batch-size", "Largest evaluation batch shared by server sessions (default: from config, or 16)",
+     cxxopts::value<int>())
+    ("batch-wait", "Milliseconds a server evaluation waits for a fuller batch", cxxopts::value<double>()->default_value("1"))
     ("h,help", "Print usage")
     ;
 
@@ -76,13 +127,129 @@ int main(int argc, const char* argv[]) {
   }
 
   auto num_rounds = args["rounds"].as<int>();
+
+  // Diagnostics go to stderr, since stdout is used for GTP.
+  TuningConfig config;
+  if (args.count("config")) {
+    try {
+      config = TuningConfig::load(args["config"].as<std::string>());
+    }
+    catch (const std::runtime_error& e) {
+      std::cerr << e.what() << std::endl;
+      exit(1);
+    }
+  }
+  if (args.count("num-threads")) {
+    std::cerr << "setting " << args["num-threads"].as<int>() << " pytorch threads" << std::endl;
+    at::set_num_threads(args["num-threads"].as<int>());
+  }
+  else if (args.count("config")) {
+    std::cerr << "setting " << config.num_threads << " pytorch threads from config" << std::endl;
+    at::set_num_threads(config.num_threads);
+  }
   
   std::cerr << "Starting DLGO...\n";
 
-  auto agent = load_agent(args["agent"].as<std::string>(),
-                           9, num_rounds);
+  auto symmetry_ensemble = args.count("symmetry-ensemble") > 0;
+  ModelLoadOptions load_options;
+  load_options.warmup_batch_sizes = {symmetry_ensemble ? 8 : 1};
+  load_options.quantized = args.count("quantized") > 0;
+  if (args.count("save-optimized"))
+    load_options.save_path = args["save-optimized"].as<std::string>();
+
+  auto ponder = args.count("ponder") > 0;
+  std::shared_ptr<NodeBudget> node_budget;
+  if (args.count("max-nodes"))
+    node_budget = std::make_shared<NodeBudget>(args["max-nodes"].as<long>());
+  else if (ponder)
+    node_budget = std::make_shared<NodeBudget>(PONDER_MAX_NODES);
+
+  auto identifier = args["agent"].as<std::string>();
+  auto gumbel = args.count("gumbel") > 0;
+
+  if (args.count("listen") || args.count("socket")) {
+    int listen_fd;
+    try {
+      listen_fd = args.count("listen") ? gtp::listen_tcp(args["listen"].as<int>()) :
+        gtp::listen_unix(args["socket"].as<std::string>());
+    }
+    catch (const std::runtime_error& e) {
+      std::cerr << e.what() << std::endl;
+      return -1;
+    }
+
+    // Each session has its own agent, while network evaluations from all
+    // sessions are batched through a single model.  The node budget is shared
+    // by all sessions.
+    std::unique_ptr<BatchingEvaluator> batching_evaluator;
+    std::function<std::unique_ptr<Agent>(int*)> make_agent;
+    if (identifier == "random" || identifier == "mcts") {
+      make_agent = [&](int*) {
+        return load_agent(identifier, 9, num_rounds, symmetry_ensemble, gumbel, load_options,
+                          node_budget, ponder);
+      };
+    }
+    else {
+      auto batch_size = args.count("batch-size") ? args["batch-size"].as<int>() :
+        (args.count("config") ? config.batch_size : 16);
+      SimpleEncoder encoder(9);
+      load_options.warmup_batch_sizes = {1, batch_size};
+      try {
+        auto evaluator = load_evaluator(identifier, encoder, load_options);
+        batching_evaluator = std::make_unique<BatchingEvaluator>(
+          evaluator, encoder.input_size(), encoder.num_moves(), batch_size,
+          args["batch-wait"].as<double>() / 1000);
+      }
+      catch (const std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        return -1;
+      }
+      std::cerr << "batching evaluations up to " << batch_size << " positions" << std::endl;
+      make_agent = [&](int* client) {
+        return make_zero_agent(batching_evaluator->make_client(client), 9, num_rounds, symmetry_ensemble,
+                               gumbel, node_budget, ponder);
+      };
+    }
+
+    std::atomic<int> num_sessions = 0;
+    std::cerr << "serving GTP sessions" << std::endl;
+    auto run_session = [&](std::istream& input, std::ostream& output) {
+      int session = ++num_sessions;
+      int client = -1;
+      std::cerr << "session " << session << " connected" << std::endl;
+      ClientStats stats;
+      {
+        gtp::GTPFrontend frontend(make_agent(&client), ponder, input, output);
+        frontend.run();
+        // The client is removed along with the agent.
+        if (client >= 0)
+          stats = batching_evaluator->client_stats(client);
+      }
+      std::cerr << "session " << session << " closed";
+      if (client >= 0) {
+        std::cerr << ": " << stats.num_positions << " positions, latency "
+                  << 1000 * stats.mean_latency() << " ms mean, "
+                  << 1000 * stats.max_latency << " ms max; mean batch "
+                  << batching_evaluator->mean_batch_size();
+      }
+      std::cerr << std::endl;
+    };
+    try {
+      gtp::serve(listen_fd, run_session);
+    }
+    catch (const std::runtime_error& e) {
+      // Exit without waiting for the sessions that are still running.
+      std::cerr << e.what() << std::endl;
+      exit(1);
+    }
+  }
+
+  auto agent = load_agent(identifier, 9, num_rounds, symmetry_ensemble, gumbel, load_options,
+                          node_budget, ponder);
+  if (! agent)
+    return -1;
 
-  auto frontend = gtp::GTPFrontend(std::move(agent));
+  auto frontend = gtp::GTPFrontend(std::move(agent), ponder);
 
   frontend.run();
 }
@@ -10,6 +10,9 @@ namespace gtp {
   struct Response {
     bool is_success;
     std::string body;
+    // A streamed response only writes its header here.  The caller writes the
+    // body as it becomes available and ends it with a blank line.
+    bool streaming = false;
 
     static Response success(std::string body = "") {
       return Response({true, body});
@@ -19,6 +22,10 @@ namespace gtp {
       return Response({false, body});
     }
 
+    static Response stream() {
+      return Response({true, "", true});
+    }
+
     static Response bool_response(bool b) {
       return b ? success("true") : success("false");
     }
@@ -31,7 +38,10 @@ namespace gtp {
         ss << "?";
       if (cmd.sequence)
         ss << cmd.sequence.value();
-      ss << " " << body << "\n\n";
+      if (streaming)
+        ss << "\n";
+      else
+        ss << " " << body << "\n\n";
       
       return ss.str();
     }
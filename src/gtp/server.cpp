@@ -0,0 +1,164 @@
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.h"
+
+namespace {
+  // Delay before accepting again when out of resources.
+  constexpr int ACCEPT_RETRY_MS = 100;
+
+  std::runtime_error socket_error(const std::string& what) {
+    return std::runtime_error(what + ": " + std::strerror(errno));
+  }
+}
+
+namespace gtp {
+
+  SocketStreamBuf::SocketStreamBuf(int fd) : fd(fd) {
+    setg(input_buffer, input_buffer, input_buffer);
+    setp(output_buffer, output_buffer + sizeof(output_buffer));
+  }
+
+
+  SocketStreamBuf::~SocketStreamBuf() {
+    sync();
+    close(fd);
+  }
+
+
+  SocketStreamBuf::int_type SocketStreamBuf::underflow() {
+    ssize_t n;
+    do {
+      n = read(fd, input_buffer, sizeof(input_buffer));
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0)
+      return traits_type::eof();
+    setg(input_buffer, input_buffer, input_buffer + n);
+    return traits_type::to_int_type(input_buffer[0]);
+  }
+
+
+  SocketStreamBuf::int_type SocketStreamBuf::overflow(int_type c) {
+    if (sync() < 0)
+      return traits_type::eof();
+    if (! traits_type::eq_int_type(c, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type(c);
+      pbump(1);
+    }
+    return traits_type::not_eof(c);
+  }
+
+
+  int SocketStreamBuf::sync() {
+    auto data = pbase();
+    while (data < pptr()) {
+      // MSG_NOSIGNAL avoids SIGPIPE if the client has gone away.
+      auto n = send(fd, data, pptr() - data, MSG_NOSIGNAL);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0) {
+        setp(output_buffer, output_buffer + sizeof(output_buffer));
+        return -1;
+      }
+      data += n;
+    }
+    setp(output_buffer, output_buffer + sizeof(output_buffer));
+    return 0;
+  }
+
+
+  int listen_tcp(int port) {
+    auto fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+      throw socket_error("unable to create socket");
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+        listen(fd, SOMAXCONN) < 0) {
+      close(fd);
+      throw socket_error("unable to listen on port " + std::to_string(port));
+    }
+    return fd;
+  }
+
+
+  int listen_unix(const std::string& path) {
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path))
+      throw std::runtime_error("socket path too long: " + path);
+    // Only a stale socket is replaced, never another kind of file.
+    struct stat info;
+    if (lstat(path.c_str(), &info) == 0) {
+      if (! S_ISSOCK(info.st_mode))
+        throw std::runtime_error("path exists and is not a socket: " + path);
+      unlink(path.c_str());
+    }
+    auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+      throw socket_error("unable to create socket");
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, path.c_str());
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+        listen(fd, SOMAXCONN) < 0) {
+      close(fd);
+      throw socket_error("unable to listen on " + path);
+    }
+    return fd;
+  }
+
+
+  void serve(int listen_fd, const Session& session) {
+    while (true) {
+      auto fd = accept(listen_fd, nullptr, nullptr);
+      if (fd < 0) {
+        switch (errno) {
+        case EINTR:
+        case ECONNABORTED:
+        case EPROTO:
+          // The pending connection failed, not the socket.
+          continue;
+        case EMFILE:
+        case ENFILE:
+        case ENOBUFS:
+        case ENOMEM:
+          // Out of descriptors or memory until sessions close, so back off
+          // rather than retrying at once.
+          std::cerr << "accept failed: " << std::strerror(errno) << std::endl;
+          std::this_thread::sleep_for(std::chrono::milliseconds(ACCEPT_RETRY_MS));
+          continue;
+        default:
+          throw socket_error("accept");
+        }
+      }
+      // Sessions end when their client disconnects or sends quit.  An error
+      // in one session only closes its connection, since an exception escaping
+      // the thread would end every session.
+      std::thread([fd, &session]() {
+        SocketStreamBuf buffer(fd);
+        std::istream input(&buffer);
+        std::ostream output(&buffer);
+        try {
+          session(input, output);
+        }
+        catch (const std::exception& e) {
+          std::cerr << "session failed: " << e.what() << std::endl;
+        }
+      }).detach();
+    }
+  }
+
+}
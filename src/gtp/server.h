@@ -0,0 +1,50 @@
+#ifndef GTP_SERVER_H
+#define GTP_SERVER_H
+
+#include <functional>
+#include <iostream>
+#include <streambuf>
+#include <string>
+
+namespace gtp {
+
+  /// Stream buffer over a connected socket, which it closes when destroyed.
+  class SocketStreamBuf : public std::streambuf {
+    int fd;
+    char input_buffer[4096];
+    char output_buffer[4096];
+
+  public:
+    explicit SocketStreamBuf(int fd);
+    ~SocketStreamBuf();
+
+    SocketStreamBuf(const SocketStreamBuf&) = delete;
+    SocketStreamBuf& operator=(const SocketStreamBuf&) = delete;
+
+  protected:
+    int_type underflow() override;
+    int_type overflow(int_type c) override;
+    int sync() override;
+  };
+
+
+  /// A GTP session on a connection, reading commands from the input stream
+  /// and writing responses to the output stream.
+  using Session = std::function<void(std::istream&, std::ostream&)>;
+
+  /// Listen for connections on a TCP port of the loopback interface.  Throws
+  /// std::runtime_error on failure.
+  int listen_tcp(int port);
+
+  /// Listen for connections on a Unix-domain socket, replacing any existing
+  /// socket file at the path.  Throws std::runtime_error on failure, or if
+  /// the path exists and isn't a socket.
+  int listen_unix(const std::string& path);
+
+  /// Accept connections and run a session for each in its own thread.  Does
+  /// not return; throws std::runtime_error if the listening socket fails.
+  [[noreturn]] void serve(int listen_fd, const Session& session);
+
+}
+
+#endif // GTP_SERVER_H
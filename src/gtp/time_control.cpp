@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <cmath>
+
+#include "time_control.h"
+
+namespace gtp {
+
+  TimeSettings TimeSettings::from_gtp(double main_time, double byo_yomi_time, int byo_yomi_stones) {
+    TimeSettings settings;
+    if (byo_yomi_time > 0 && byo_yomi_stones == 0)
+      return settings;
+    settings.main_time = main_time;
+    if (byo_yomi_time > 0) {
+      settings.system = System::canadian;
+      settings.period_time = byo_yomi_time;
+      settings.period_stones = byo_yomi_stones;
+    }
+    else
+      settings.system = System::absolute;
+    return settings;
+  }
+
+
+  GameClock::GameClock(const TimeSettings& settings) :
+    settings(settings), main_left(settings.main_time),
+    period_left(settings.period_time), stones_left(settings.period_stones) {
+    in_overtime = settings.main_time <= 0 && settings.system != TimeSettings::System::absolute;
+  }
+
+
+  void GameClock::set_time_left(double time, int stones) {
+    if (stones == 0) {
+      main_left = time;
+      in_overtime = false;
+    }
+    else {
+      main_left = 0.0;
+      in_overtime = true;
+      period_left = time;
+      stones_left = stones;
+    }
+  }
+
+
+  void GameClock::record_move(double seconds) {
+    using System = TimeSettings::System;
+    if (settings.system == System::none)
+      return;
+    if (! in_overtime) {
+      main_left -= seconds;
+      if (main_left >= 0 || settings.system == System::absolute)
+        return;
+      seconds = -main_left;
+      main_left = 0.0;
+      in_overtime = true;
+    }
+    if (settings.system == System::byo_yomi) {
+      // Each full period used up is lost, and the period resets every move.
+      auto lost = static_cast<int>(seconds / settings.period_time);
+      stones_left = std::max(stones_left - lost, 1);
+      period_left = settings.period_time;
+    }
+    else {
+      period_left -= seconds;
+      if (--stones_left <= 0) {
+        period_left = settings.period_time;
+        stones_left = settings.period_stones;
+      }
+    }
+  }
+
+
+  std::optional<TimeBudget> GameClock::budget(int board_size, int moves_played) const {
+    using System = TimeSettings::System;
+    if (settings.system == System::none)
+      return std::nullopt;
+
+    double target = 0.0;
+    double maximum = 0.0;
+    if (! in_overtime) {
+      // Share the main time among this player's expected remaining moves.
+      const double points = board_size * board_size;
+      auto remaining = std::max(GAME_LENGTH_FRACTION * points - moves_played,
+                                MIN_REMAINING_FRACTION * points) / 2;
+      auto available = main_left - LAG_BUFFER;
+      target = available / remaining;
+      if (moves_played < board_size)
+        target *= OPENING_FACTOR;
+      maximum = std::min(MAX_EXTENSION * target, 0.5 * available);
+      if (settings.system != System::absolute) {
+        // Overtime follows, and is available to every move.
+        auto overtime = settings.system == System::byo_yomi ?
+          settings.period_time : settings.period_time / settings.period_stones;
+        target += 0.5 * overtime;
+        maximum += 0.5 * overtime;
+      }
+    }
+    else if (settings.system == System::byo_yomi) {
+      // The period resets every move, so most of it can be used.
+      auto available = period_left - LAG_BUFFER;
+      target = 0.5 * available;
+      maximum = 0.9 * available;
+    }
+    else {
+      auto available = period_left - LAG_BUFFER;
+      target = available / std::max(stones_left, 1);
+      maximum = std::min(MAX_EXTENSION * target, 0.5 * available);
+    }
+    target = std::max(target, MIN_MOVE_TIME);
+    maximum = std::max(maximum, target);
+    return TimeBudget{target, maximum};
+  }
+
+}
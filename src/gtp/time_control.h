@@ -0,0 +1,68 @@
+#ifndef GTP_TIME_CONTROL_H
+#define GTP_TIME_CONTROL_H
+
+#include <optional>
+
+#include "../agent_base.h"
+
+namespace gtp {
+
+  /// Time settings from the time_settings and kgs-time_settings commands.
+  struct TimeSettings {
+    enum class System { none, absolute, byo_yomi, canadian };
+    System system = System::none;
+    double main_time = 0.0;
+    // Length of a byo-yomi period, or of the Canadian overtime block.
+    double period_time = 0.0;
+    // Number of byo-yomi periods, or stones per Canadian overtime block.
+    int period_stones = 0;
+
+    /// GTP time_settings: Canadian overtime, or absolute time if there is no
+    /// overtime.  Overtime without stones means no time limit.
+    static TimeSettings from_gtp(double main_time, double byo_yomi_time, int byo_yomi_stones);
+  };
+
+
+  /// Clock for one player.  The remaining time is tracked locally after each
+  /// move and corrected by time_left when the controller sends it.
+  class GameClock {
+    TimeSettings settings;
+    double main_left = 0.0;
+    bool in_overtime = false;
+    double period_left = 0.0;
+    // Byo-yomi periods, or Canadian stones, left.
+    int stones_left = 0;
+
+    // Safety margin for network and controller lag, in seconds.
+    constexpr static double LAG_BUFFER = 0.5;
+    constexpr static double MIN_MOVE_TIME = 0.05;
+    // Expected game length as a fraction of the board points, and the
+    // smallest number of remaining moves assumed for the game.
+    constexpr static double GAME_LENGTH_FRACTION = 0.75;
+    constexpr static double MIN_REMAINING_FRACTION = 0.2;
+    // Opening moves get a smaller share, since their priors are more
+    // reliable and time is more valuable in the middle game.
+    constexpr static double OPENING_FACTOR = 0.5;
+    // The search may run past its target up to this factor when unsettled.
+    constexpr static double MAX_EXTENSION = 3.0;
+
+  public:
+    GameClock(const TimeSettings& settings = {});
+
+    const TimeSettings& get_settings() const { return settings; }
+
+    /// GTP time_left: stones is 0 during main time, otherwise the stones (or
+    /// byo-yomi periods) left for the time in overtime.
+    void set_time_left(double time, int stones);
+
+    /// Update the clock after spending `seconds` on a move.
+    void record_move(double seconds);
+
+    /// Time to spend on the next move, with `moves_played` moves in the game
+    /// so far.  Empty if there is no time limit.
+    std::optional<TimeBudget> budget(int board_size, int moves_played) const;
+  };
+
+}
+
+#endif // GTP_TIME_CONTROL_H
@@ -1,6 +1,10 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <iostream>
 #include <iomanip>
 #include <chrono>
+#include <mutex>
 #include <thread>
 #include <string>
 #include <array>
@@ -10,43 +14,106 @@
 
 #include "goboard.h"
 #include "zero/agent_zero.h"
+#include "zero/batching_evaluator.h"
+#include "zero/model_loader.h"
+#include "zero/tuning.h"
+#include "zero/native_net.h"
 #include "utils.h"
 #include "scoring.h"
 #include "simulation.h"
 #include "agent_naive.h"
 
 
-std::unique_ptr<Agent> load_zero_agent(const std::string network_path,
-                                       int board_size,
-                                       int num_rounds) {
-  c10::InferenceMode guard;
-  torch::jit::script::Module model;
+/// Evaluator shared by the games that one network plays concurrently, so
+/// that their positions are evaluated in batches.
+std::unique_ptr<BatchingEvaluator> load_batching_evaluator(const std::string network_path,
+                                                           int board_size,
+                                                           bool quantized,
+                                                           int batch_size,
+                                                           double batch_wait) {
+  SimpleEncoder encoder(board_size);
+  ModelLoadOptions load_options;
+  load_options.warmup_batch_sizes = {batch_size};
+  load_options.quantized = quantized;
   try {
-    model = torch::jit::load(network_path);
+    auto evaluator = load_evaluator(network_path, encoder, load_options);
+    return std::make_unique<BatchingEvaluator>(evaluator, encoder.input_size(), encoder.num_moves(),
+                                               batch_size, batch_wait);
   }
-  catch (const c10::Error& e) {
-    std::cerr << "Error loading model: " << network_path << std::endl;
+  catch (const std::runtime_error& e) {
+    std::cerr << e.what() << std::endl;
     // Return emptpy pointer
-    return std::unique_ptr<Agent>();
+    return std::unique_ptr<BatchingEvaluator>();
   }
+}
+
 
-  std::cout << "Loaded: " << network_path << std::endl;
+/// Agent for one worker.  Without a batching evaluator, the agent is random.
+std::unique_ptr<Agent> make_agent(BatchingEvaluator* batching_evaluator,
+                                  int board_size,
+                                  int num_rounds,
+                                  bool symmetry_ensemble,
+                                  bool early_stopping,
+                                  bool graph_search,
+                                  std::shared_ptr<NodeBudget> node_budget) {
+  if (! batching_evaluator)
+    return std::make_unique<FastRandomBot>();
 
   auto encoder = std::make_shared<SimpleEncoder>(board_size);
-  auto agent = std::make_unique<ZeroAgent>(model, encoder, num_rounds, true);
+  auto agent = std::make_unique<ZeroAgent>(batching_evaluator->make_client(), encoder, num_rounds, true);
+  agent->set_symmetry_ensemble(symmetry_ensemble);
+  agent->set_early_stopping(early_stopping);
+  agent->set_graph_search(graph_search);
+  agent->set_node_budget(node_budget);
   return agent;
 }
 
 
-std::unique_ptr<Agent> load_agent(const std::string identifier,
-                                       int board_size,
-                                       int num_rounds) {
-  if (identifier == "random") {
-    std::cout << "loading random agent" << std::endl;
-    return std::make_unique<FastRandomBot>();
+/// Compare int8 and float evaluations of a native network on positions from
+/// random games, to go with the strength comparison from the match.
+void report_quantization_error(const std::string network_path, int board_size, int num_games) {
+  auto weights = NativeNetWeights::load(network_path);
+  NativeNet float_net(weights);
+  NativeNet int8_net(weights, true);
+  SimpleEncoder encoder(board_size);
+  FastRandomBot random_bot;
+
+  std::vector<float> input(encoder.input_size());
+  std::vector<float> float_priors(encoder.num_moves()), int8_priors(encoder.num_moves());
+  float float_value, int8_value;
+  int num_positions = 0;
+  int top_move_matches = 0;
+  double total_value_error = 0.0;
+  double max_value_error = 0.0;
+  double total_policy_error = 0.0;
+  for (int game_num=0; game_num < num_games; ++game_num) {
+    auto game = GameState::new_game(board_size);
+    for (int move_num=0; move_num < 2 * board_size * board_size && ! game->is_over(); ++move_num) {
+      encoder.encode_into(*game, input.data());
+      float_net.forward(input.data(), 1, float_priors.data(), &float_value);
+      int8_net.forward(input.data(), 1, int8_priors.data(), &int8_value);
+
+      double value_error = std::abs(int8_value - float_value);
+      total_value_error += value_error;
+      max_value_error = std::max(max_value_error, value_error);
+      // Total variation distance between the policies.
+      double policy_error = 0.0;
+      for (size_t i=0; i < float_priors.size(); ++i)
+        policy_error += std::abs(int8_priors[i] - float_priors[i]);
+      total_policy_error += 0.5 * policy_error;
+      if (std::max_element(float_priors.begin(), float_priors.end()) - float_priors.begin() ==
+          std::max_element(int8_priors.begin(), int8_priors.end()) - int8_priors.begin())
+        ++top_move_matches;
+      ++num_positions;
+
+      game = game->apply_move(random_bot.select_move(*game));
+    }
   }
-  else
-    return load_zero_agent(identifier, board_size, num_rounds);
+
+  std::cout << "int8 vs float over " << num_positions << " positions: ";
+  std::cout << "value error " << total_value_error / num_positions << " mean, " << max_value_error << " max";
+  std::cout << ", policy distance " << total_policy_error / num_positions;
+  std::cout << ", " << 100.0 * top_move_matches / num_positions << "% same top move" << std::endl;
 }
 
 
@@ -61,7 +128,18 @@ int main(int argc, const char* argv[]) {
     ("g,num-games", "Number of games", cxxopts::value<int>()->default_value("1"))
     ("b,board-size", "Board size", cxxopts::value<int>()->default_value("9"))
     ("v,verbosity", "Verbosity level", cxxopts::value<int>()->default_value("0"))
+    ("w,workers", "Games played concurrently (default: twice the batch size)", cxxopts::value<int>())
+    ("batch-size", "Largest evaluation batch for each network (default: from config, or 16)",
+     cxxopts::value<int>())
+    ("batch-wait", "Milliseconds an evaluation waits for a fuller batch", cxxopts::value<double>()->default_value("1"))
     ("t,num-threads", "Number of pytorch threads", cxxopts::value<int>())
+    ("config", "Tuning configuration from autotune (num-threads takes precedence)", cxxopts::value<std::string>())
+    ("s,symmetry-ensemble", "Average network evaluations over all 8 board symmetries")
+    ("early-stop", "Stop searching once the most visited move can't change")
+    ("graph", "Merge transpositions in the search tree")
+    ("quantized", "Use int8 inference for agent1 (calibrated native networks only)")
+    ("max-nodes", "Limit the total size of the search trees, pruning the least visited subtrees",
+     cxxopts::value<long>())
     ("h,help", "Print usage")
     ;
 
@@ -92,72 +170,165 @@ int main(int argc, const char* argv[]) {
   auto board_size = args["board-size"].as<int>();
   auto verbosity = args["verbosity"].as<int>();
 
+  TuningConfig config;
+  if (args.count("config")) {
+    try {
+      config = TuningConfig::load(args["config"].as<std::string>());
+    }
+    catch (const std::runtime_error& e) {
+      std::cerr << e.what() << std::endl;
+      exit(1);
+    }
+  }
   if (args.count("num-threads")) {
     std::cout << "setting " << args["num-threads"].as<int>() << " pytorch threads" << std::endl;
     at::set_num_threads(args["num-threads"].as<int>());
   }
+  else if (args.count("config")) {
+    std::cout << "setting " << config.num_threads << " pytorch threads from config" << std::endl;
+    at::set_num_threads(config.num_threads);
+  }
+  auto batch_size = args.count("batch-size") ? args["batch-size"].as<int>() :
+    (args.count("config") ? config.batch_size : 16);
+  // Each game waits on one network at a time, so each network has about half
+  // of the games' searches to batch.
+  auto num_workers = std::min(num_games, args.count("workers") ? args["workers"].as<int>() : 2 * batch_size);
+  auto batch_wait = args["batch-wait"].as<double>() / 1000;
 
-  auto agent1 = load_agent(args["agent1"].as<std::string>(),
-                           board_size, num_rounds);
-  auto agent2 = load_agent(args["agent2"].as<std::string>(),
-                           board_size, num_rounds);
-  if (! agent1 || ! agent2)
-    return -1;
+  auto symmetry_ensemble = args.count("symmetry-ensemble") > 0;
+  auto early_stopping = args.count("early-stop") > 0;
+  auto graph_search = args.count("graph") > 0;
+  auto quantized = args.count("quantized") > 0;
+  // Shared by all agents, so that it bounds the memory of concurrent games.
+  std::shared_ptr<NodeBudget> node_budget;
+  if (args.count("max-nodes"))
+    node_budget = std::make_shared<NodeBudget>(args["max-nodes"].as<long>());
 
+  const std::array<std::string, 2> identifiers = {args["agent1"].as<std::string>(),
+                                                  args["agent2"].as<std::string>()};
+  std::array<std::unique_ptr<BatchingEvaluator>, 2> batching_evaluators;
+  for (int i=0; i<2; ++i) {
+    if (identifiers[i] == "random") {
+      std::cout << "loading random agent" << std::endl;
+      continue;
+    }
+    batching_evaluators[i] = load_batching_evaluator(identifiers[i], board_size, quantized && i == 0,
+                                                     batch_size, batch_wait);
+    if (! batching_evaluators[i])
+      return -1;
+  }
 
-  Agent* black_agent;
-  Agent* white_agent;
+  if (quantized && batching_evaluators[0])
+    report_quantization_error(identifiers[0], board_size, 20);
 
+  // Agents for each worker, as agent1 and agent2.  Declared after the
+  // evaluators so that their clients are destroyed first.
+  std::vector<std::array<std::unique_ptr<Agent>, 2>> agents(num_workers);
+  for (auto& worker_agents : agents) {
+    for (int i=0; i<2; ++i)
+      worker_agents[i] = make_agent(batching_evaluators[i].get(), board_size, num_rounds,
+                                    symmetry_ensemble, early_stopping, graph_search, node_budget);
+  }
+  std::cout << "playing " << num_workers << " games at a time" << std::endl;
+
+  std::atomic<int> next_game = 0;
+  std::mutex progress_mutex;
+  int num_games_done = 0;
   int agent1_wins = 0;
   int agent1_wins_as_black = 0;
   int agent1_num_black_games = 0;
   int total_num_moves = 0;
   auto cumulative_timer = Timer();
-  for (int game_num=0; game_num < num_games; ++game_num) {
-    if (game_num % 2 == 0) {
+  auto work = [&](int worker) {
+    auto agent1 = agents[worker][0].get();
+    auto agent2 = agents[worker][1].get();
+    for (int game_num = next_game++; game_num < num_games; game_num = next_game++) {
       // Agent 1 plays black on even games
-      black_agent = agent1.get();
-      white_agent = agent2.get();
-      ++agent1_num_black_games;
-    } else {
-      black_agent = agent2.get();
-      white_agent = agent1.get();
-    }
-    auto timer = Timer();
-    auto [winner, num_moves] = simulate_game(board_size, black_agent, white_agent, verbosity);
-    auto duration = timer.elapsed();
-    total_num_moves += num_moves;
-    if (num_games <= 5) {
-      std::cout << "Game: " << num_moves << " moves in " << duration;
-      std:: cout << " s (" << num_moves / duration << " mv/s, " << duration / num_moves << " s/mv)" << std::endl;
-    }
+      auto agent1_black = game_num % 2 == 0;
+      auto timer = Timer();
+      auto [winner, num_moves] = agent1_black ?
+        simulate_game(board_size, agent1, agent2, verbosity) :
+        simulate_game(board_size, agent2, agent1, verbosity);
+      auto duration = timer.elapsed();
+      auto agent1_won = winner == (agent1_black ? Player::black : Player::white);
 
-    if (game_num % 2 == 0) {
-      // Agent 1 plays black
-      if (winner == Player::black) {
-        ++agent1_wins;
-        ++agent1_wins_as_black;
-      }
-    }
-    else {
-      // Agent 1 plays white
-      if (winner == Player::white) {
+      std::lock_guard<std::mutex> lock(progress_mutex);
+      ++num_games_done;
+      total_num_moves += num_moves;
+      if (agent1_black)
+        ++agent1_num_black_games;
+      if (agent1_won) {
         ++agent1_wins;
+        if (agent1_black)
+          ++agent1_wins_as_black;
       }
+
+      std::cout << "Game " << game_num + 1 << ": agent1 " << (agent1_won ? "won" : "lost")
+                << " as " << (agent1_black ? "B" : "W") << ", " << num_moves << " moves in "
+                << format_seconds(duration) << std::endl;
+
+      auto total_duration = cumulative_timer.elapsed();
+      auto games_per_sec = num_games_done / total_duration;
+      auto remaining_sec = (num_games - num_games_done) / games_per_sec;
+      auto elo = estimate_elo(agent1_wins, num_games_done);
+      std::cout << agent1_wins << "/" << num_games_done << "/" << num_games;
+      std::cout << std::fixed << std::setprecision(1);
+      std::cout << " (" << 100.0 * agent1_wins / num_games_done << "%";
+      if (agent1_num_black_games > 0)
+        std::cout << ", " << 100.0 * agent1_wins_as_black / agent1_num_black_games << "% as Blk";
+      std::cout << "), " << static_cast<double>(total_num_moves) / num_games_done << " mpg";
+      std::cout << std::setprecision(0) << ", Elo " << std::showpos << elo.elo
+                << " [" << elo.lower << ", " << elo.upper << "]" << std::noshowpos;
+      std::cout << std::defaultfloat << std::setprecision(4);
+      std::cout << ", " << total_num_moves / total_duration << " mps";
+      std::cout << "  [" << format_seconds(total_duration) << " < " << format_seconds(remaining_sec) << "]" << std::endl;
     }
+  };
 
-    auto total_duration = cumulative_timer.elapsed();
-    auto games_per_sec = (game_num + 1) / total_duration;
-    auto remaining_sec = (num_games - game_num - 1) / games_per_sec;
-    std::cout << agent1_wins << "/" << game_num + 1 << "/" << num_games;
-    std::cout << std::fixed << std::setprecision(1);
-    std::cout << " (" << 100.0 * agent1_wins / (game_num + 1) << "%";
-    std::cout << ", " << 100.0 * agent1_wins_as_black / agent1_num_black_games << "% as Blk)";
-    std::cout << ", " << total_num_moves / (game_num + 1) << " mpg";
-    std::cout << std::defaultfloat << std::setprecision(4);
-    std::cout << ", " << total_num_moves / total_duration << " mps";
-    std::cout << "  [" << format_seconds(total_duration) << " < " << format_seconds(remaining_sec) << "]" << std::endl;
+  std::vector<std::thread> workers;
+  for (int w=0; w<num_workers; ++w)
+    workers.emplace_back(work, w);
+  for (auto& worker : workers)
+    worker.join();
+
+  auto elo = estimate_elo(agent1_wins, num_games);
+  std::cout << std::fixed << std::setprecision(0) << std::showpos;
+  std::cout << "agent1 Elo: " << elo.elo << " (95% CI " << elo.lower << " to " << elo.upper << ")"
+            << std::noshowpos << std::defaultfloat << std::setprecision(4);
+  for (int i=0; i<2; ++i) {
+    if (batching_evaluators[i])
+      std::cout << ", agent" << i + 1 << " mean batch " << batching_evaluators[i]->mean_batch_size();
+  }
+  std::cout << std::endl;
 
+  if (early_stopping || graph_search) {
+    for (int i=0; i<2; ++i) {
+      // Totals over the workers' agents.
+      SearchStats stats;
+      for (const auto& worker_agents : agents) {
+        auto zero_agent = dynamic_cast<ZeroAgent*>(worker_agents[i].get());
+        if (! zero_agent)
+          continue;
+        const auto& agent_stats = zero_agent->get_stats();
+        stats.num_moves += agent_stats.num_moves;
+        stats.num_rounds += agent_stats.num_rounds;
+        stats.rounds_saved += agent_stats.rounds_saved;
+        stats.num_evaluations += agent_stats.num_evaluations;
+        stats.num_transpositions += agent_stats.num_transpositions;
+      }
+      // Random agents, and zero agents that never searched, e.g. because every
+      // game ended before their first move, have nothing to report.
+      if (stats.num_moves == 0)
+        continue;
+      std::cout << "agent" << i + 1 << ": " << static_cast<double>(stats.num_rounds) / stats.num_moves << " rounds per move";
+      if (early_stopping)
+        std::cout << ", " << static_cast<double>(stats.rounds_saved) / stats.num_moves << " saved";
+      if (graph_search) {
+        auto num_expansions = stats.num_evaluations + stats.num_transpositions;
+        std::cout << ", " << 100.0 * stats.num_transpositions / num_expansions << "% merged";
+      }
+      std::cout << std::endl;
+    }
   }
 
 }
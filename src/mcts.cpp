@@ -1,89 +1,217 @@
 #include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <numeric>
 
 #include "mcts.h"
 #include "agent_naive.h"
+#include "uct_kernel.h"
+#include "utils.h"
+
+
+void MCTSNode::init(ConstGameStatePtr game_state,
+                    std::weak_ptr<MCTSNode> parent,
+                    std::optional<Move> move) {
+  this->game_state = game_state;
+  this->parent = parent;
+  this->move = move;
+  win_counts[0] = win_counts[1] = 0;
+  num_rollouts = 0;
+  child_index = -1;
+  proven_winner.reset();
+  // Clearing keeps the capacity of a recycled node's vectors.
+  legal_moves.clear();
+  unvisited_moves.clear();
+  children.clear();
+  child_moves.clear();
+  child_wins.clear();
+  child_rollouts.clear();
+
+  if (game_state->is_over()) {
+    proven_winner = game_state->winner();
+    return;
+  }
+  legal_moves = game_state->legal_moves();
+  for (size_t i=0; i<legal_moves.size(); ++i)
+    unvisited_moves.push_back(i);
+  std::shuffle(unvisited_moves.begin(), unvisited_moves.end(), rng);
+}
 
 
-std::shared_ptr<MCTSNode> MCTSNode::add_random_child() {
+std::shared_ptr<MCTSNode> MCTSNode::add_random_child(NodePool<MCTSNode>& pool) {
   // The array of indices has been randomly shuffled, so we just pop from the
   // back.
   auto move_index = unvisited_moves.back();
   unvisited_moves.pop_back();
   auto new_move = legal_moves[move_index];
   auto new_game_state = game_state->apply_move(new_move);
-  auto new_node = std::make_shared<MCTSNode>(new_game_state, weak_from_this(), new_move);
+  auto new_node = pool.make(new_game_state, weak_from_this(), new_move);
+  new_node->child_index = children.size();
   children.push_back(new_node);
+  child_moves.push_back(new_move);
+  child_wins.push_back(0);
+  child_rollouts.push_back(0);
   return new_node;
 }
 
 
+void MCTSNode::restore_child(int index, NodePool<MCTSNode>& pool) {
+  auto child_move = child_moves[index];
+  children[index] = pool.make(game_state->apply_move(child_move), weak_from_this(), child_move);
+  children[index]->child_index = index;
+}
+
+
+
+bool MCTSNode::update_proof(int index) {
+  if (proven_winner)
+    return false;
+  const auto& child_winner = children[index]->proven_winner;
+  if (! child_winner)
+    return false;
+  auto player = game_state->next_player;
+  if (child_winner.value() == player) {
+    proven_winner = player;
+    return true;
+  }
+  if (can_add_child())
+    return false;
+  for (const auto& child : children) {
+    if (! child || child->proven_winner != other_player(player))
+      return false;
+  }
+  proven_winner = other_player(player);
+  return true;
+}
+
+
+
+bool MCTSAgent::is_search_settled(const MCTSNode& root) {
+  int best = -1;
+  int second = -1;
+  for (int i=0; i<static_cast<int>(root.child_rollouts.size()); ++i) {
+    if (best < 0 || root.child_rollouts[i] > root.child_rollouts[best]) {
+      second = best;
+      best = i;
+    }
+    else if (second < 0 || root.child_rollouts[i] > root.child_rollouts[second])
+      second = i;
+  }
+  if (best < 0 || root.can_add_child())
+    return false;
+  if (second < 0 || root.child_rollouts[second] == 0)
+    return true;
+  auto rate = [&](int i) { return float(root.child_wins[i]) / float(root.child_rollouts[i]); };
+  return root.child_rollouts[best] >= 2 * root.child_rollouts[second] && rate(second) <= rate(best);
+}
+
 
 Move MCTSAgent::select_move(const GameState& game_state)  {
-  auto root = std::make_shared<MCTSNode>(std::make_shared<const GameState>(game_state));
+  auto root = node_pool.make(std::make_shared<const GameState>(game_state));
+
+  auto timer = Timer();
+  // Stop once the root is proven.
+  for (auto i=0; (time_budget || i<num_rounds) && ! root->proven_winner; ++i) {
+    if (time_budget && i > 0) {
+      auto elapsed = timer.elapsed();
+      if (elapsed >= time_budget->maximum ||
+          (elapsed >= time_budget->target && is_search_settled(*root)))
+        break;
+    }
 
-  for (auto i=0; i<num_rounds; ++i) {
     // std:: cout << "Round: " << i << std::endl;
+    if (node_pool.exhausted())
+      prune_tree(*root);
+
     auto node = root;
-    while ((! node->can_add_child()) && (! node->is_terminal()))
-      node = select_child(node);
+    // Terminal nodes are always proven, and proven nodes need no further
+    // search.
+    while ((! node->can_add_child()) && (! node->proven_winner))
+      node = select_child(*node);
 
     // Add a new child node into the tree.
-    if (node->can_add_child())
-      node = node->add_random_child();
+    if (node->can_add_child() && ! node->proven_winner)
+      node = node->add_random_child(node_pool);
 
-    // Simulate a random game from this node.
-    auto winner = simulate_random_game(node->game_state);
+    // Simulate a random game from this node, unless the result is known.
+    auto winner = node->proven_winner ? node->proven_winner.value() :
+      simulate_random_game(node->game_state);
 
     // Propagate scores back up the tree.
+    bool proven = true;
     while (true) {
       node->record_win(winner);
       if (node->parent.expired())
         break;
-      node = MCTSNodePtr(node->parent); // Weak ptr to shared ptr
+      auto parent = MCTSNodePtr(node->parent); // Weak ptr to shared ptr
+      parent->record_child_win(node->child_index, winner);
+      if (proven)
+        proven = parent->update_proof(node->child_index);
+      node = parent;
+    }
+  }
+
+  // Play a proven win if there is one.
+  if (root->proven_winner == game_state.next_player) {
+    for (const auto& child : root->children) {
+      if (child && child->proven_winner == game_state.next_player)
+        return child->move.value();
     }
   }
 
-  // Having performed the MCTS rounds, we now pick a move.
+  // Having performed the MCTS rounds, we now pick a move.  The root's edge
+  // statistics are used, since pruned children have no node.
   auto best_move = Move::pass();
   float best_pct = -1.0;
-  for (const auto& child : root->children) {
-    auto child_pct = child->winning_frac(game_state.next_player);
+  for (size_t i=0; i<root->children.size(); ++i) {
+    auto child_pct = float(root->child_wins[i]) / float(root->child_rollouts[i]);
     if (child_pct > best_pct) {
       best_pct = child_pct;
-      best_move = child->move.value();
+      best_move = root->child_moves[i];
     }
   }
   return best_move;
 }
 
 
+void MCTSAgent::prune_tree(MCTSNode& root) {
+  // Same threshold passes as ZeroAgent::prune_tree, on rollout counts.
+  const long target = node_pool.prune_target(PRUNE_TARGET);
+  std::vector<MCTSNode*> stack;
+  for (int threshold=1; node_pool.size() > target && threshold <= root.num_rollouts; threshold *= 2) {
+    stack.assign(1, &root);
+    while (! stack.empty()) {
+      auto node = stack.back();
+      stack.pop_back();
+      for (size_t i=0; i<node->children.size(); ++i) {
+        auto& child = node->children[i];
+        if (! child || child->proven_winner)
+          continue;
+        if (node->child_rollouts[i] <= threshold)
+          child.reset();
+        else
+          stack.push_back(child.get());
+      }
+    }
+  }
+}
+
+
 
 /// Select a child according to the upper confidence bound for trees (UCT)
 /// metric.
-MCTSNodePtr MCTSAgent::select_child(MCTSNodePtr node) {
-  assert(! node->children.empty());
-  auto total_rollouts = std::accumulate(node->children.begin(),
-                                        node->children.end(),
-                                        0,
-                                        [](int total, auto b){return total + b->num_rollouts;});
-  auto log_rollouts = log(total_rollouts);
-
-  auto best_score = -1;
-  MCTSNodePtr best_child;
-  for (const auto& child : node->children) {
-    // Calculate the UCT score.
-    auto win_percentage = child->winning_frac(node->game_state->next_player);
-    auto exploration_factor = sqrt(log_rollouts / child->num_rollouts);
-    auto uct_score = win_percentage + temperature * exploration_factor;
-    // Check if this is the largest we've seen so far.
-    if (uct_score > best_score) {
-      best_score = uct_score;
-      best_child = child;
-    }
-  }
-  return best_child;
+MCTSNodePtr MCTSAgent::select_child(MCTSNode& node) {
+  assert(! node.children.empty());
+  auto total_rollouts = std::accumulate(node.child_rollouts.begin(),
+                                        node.child_rollouts.end(),
+                                        0);
+  auto log_rollouts = std::log(static_cast<float>(total_rollouts));
+
+  auto best = select_uct(node.child_wins.data(), node.child_rollouts.data(),
+                         node.children.size(), temperature, log_rollouts);
+  if (! node.children[best])
+    node.restore_child(best, node_pool);
+  return node.children[best];
 }
 
 Player MCTSAgent::simulate_random_game(ConstGameStatePtr game) {
@@ -8,6 +8,7 @@
 #include "goboard.h"
 #include "myrand.h"
 #include "agent_base.h"
+#include "node_pool.h"
 
 class MCTSNode;
 using MCTSNodePtr = std::shared_ptr<MCTSNode>;
@@ -24,28 +25,63 @@ class MCTSNode : public std::enable_shared_from_this<MCTSNode> {
 
 public:
   ConstGameStatePtr game_state;
+  /* Children may be null after being pruned to stay within a node budget.
+  Their moves and statistics are kept below. */
   std::vector<MCTSNodePtr> children;
+  std::vector<Move> child_moves;
+  /* Win and rollout counts for each child, stored contiguously so that child
+  selection can be vectorized.  Wins are counted for the player to move at this
+  node. */
+  std::vector<int> child_wins;
+  std::vector<int> child_rollouts;
   std::weak_ptr<MCTSNode> parent;
   int num_rollouts = 0;
   std::optional<Move> move;
+  // Position of this node within the parent's children.
+  int child_index = -1;
+  // Winner under perfect play, once proven by the search.
+  std::optional<Player> proven_winner;
 
   MCTSNode(ConstGameStatePtr game_state,
            std::weak_ptr<MCTSNode> parent = std::weak_ptr<MCTSNode>(),
-           std::optional<Move> move = std::nullopt) :
-    game_state(game_state), parent(parent), move(move) {
-    legal_moves = game_state->legal_moves();
-    for (size_t i=0; i<legal_moves.size(); ++i)
-      unvisited_moves.push_back(i);
-    std::shuffle(unvisited_moves.begin(), unvisited_moves.end(), rng);
+           std::optional<Move> move = std::nullopt) {
+    init(game_state, parent, move);
   }
 
-  std::shared_ptr<MCTSNode> add_random_child();
+  /// Reinitialize a recycled node as if newly constructed.
+  void init(ConstGameStatePtr game_state,
+            std::weak_ptr<MCTSNode> parent = std::weak_ptr<MCTSNode>(),
+            std::optional<Move> move = std::nullopt);
+
+  /// Drop references to children and the game state before recycling.
+  void release() {
+    children.clear();
+    game_state.reset();
+  }
+
+  std::shared_ptr<MCTSNode> add_random_child(NodePool<MCTSNode>& pool);
+
+  /// Create the node for a child that was pruned.  Its statistics in this node
+  /// are kept.
+  void restore_child(int index, NodePool<MCTSNode>& pool);
 
   void record_win(Player winner) {
     ++win_counts[int(winner)];
     ++num_rollouts;
   }
 
+  void record_child_win(int index, Player winner) {
+    if (winner == game_state->next_player)
+      ++child_wins[index];
+    ++child_rollouts[index];
+  }
+
+  /// Update the proof after a rollout through a child.  The node is won for
+  /// the player to move if any child is, and lost if all moves have been added
+  /// and every child is won for the opponent.  Returns true if the node became
+  /// proven.
+  bool update_proof(int index);
+
   bool can_add_child() const {
     return ! unvisited_moves.empty();
   }
@@ -63,17 +99,37 @@ public:
 class MCTSAgent : public Agent {
   int num_rounds;
   float temperature;
+  // Nodes are recycled between searches.  With a budget, the least visited
+  // subtrees are pruned when it is exhausted, as in ZeroAgent.
+  NodePool<MCTSNode> node_pool;
+  constexpr static float PRUNE_TARGET = 0.75;
+  // Under time control, rounds continue until the target once the most
+  // simulated move is settled, or until the maximum.
+  std::optional<TimeBudget> time_budget;
 public:
   MCTSAgent(int num_rounds, float temperature) :
     num_rounds(num_rounds), temperature(temperature) {}
 
   Move select_move(const GameState&);
 
+  /// Limit the number of live nodes.  The limit is soft, as for ZeroAgent.
+  void set_node_budget(std::shared_ptr<NodeBudget> budget) {
+    node_pool.set_budget(budget);
+  }
+
+  void set_time_budget(std::optional<TimeBudget> budget) override {
+    time_budget = budget;
+  }
+
   static Player simulate_random_game(ConstGameStatePtr);
 
 private:
-  MCTSNodePtr select_child(MCTSNodePtr node);
-  
+  MCTSNodePtr select_child(MCTSNode& node);
+  void prune_tree(MCTSNode& root);
+  /// True if the most simulated root move has at least twice the rollouts of
+  /// the runner-up and no worse a win rate.
+  static bool is_search_settled(const MCTSNode& root);
+
 };
 
 #endif // MCTS_H
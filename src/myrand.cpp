@@ -7,7 +7,7 @@
 //   return rng;
 // }
 
-std::default_random_engine rng(std::random_device{}());
+thread_local std::default_random_engine rng(std::random_device{}());
 // std::default_random_engine rng = get_engine();
 
 
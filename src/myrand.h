@@ -4,7 +4,9 @@
 #include <random>
 #include <vector>
 
-extern std::default_random_engine rng;
+// Each thread has its own engine, so that concurrent searches and games
+// don't share one.
+extern thread_local std::default_random_engine rng;
 
 
 class DirichletDistribution {
@@ -0,0 +1,125 @@
+#ifndef NODE_POOL_H
+#define NODE_POOL_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+/// Limit on the number of live search nodes.  A budget can be shared by agents
+/// that search concurrently, so that together they stay within the limit.
+class NodeBudget {
+  const long max_nodes;
+  std::atomic<long> num_nodes = 0;
+
+public:
+  explicit NodeBudget(long max_nodes) : max_nodes(max_nodes) {}
+
+  long limit() const { return max_nodes; }
+  long size() const { return num_nodes; }
+  bool exhausted() const { return num_nodes >= max_nodes; }
+
+  void add() { ++num_nodes; }
+  void remove() { --num_nodes; }
+};
+
+
+/// Allocates search nodes and recycles them once they are released, so that
+/// their memory, including the capacity of their vectors, is reused by later
+/// nodes.  Nodes are handed out as shared pointers whose deleter returns them
+/// to the pool, and each live node counts against the budget, if set.  The
+/// number of nodes kept for reuse is capped, at the budget's limit if there is
+/// one, and released nodes beyond the cap are deleted.
+///
+/// T must be constructible from the arguments to make(), provide init() with
+/// the same arguments to reinitialize a recycled node, and provide release()
+/// to drop its references to other nodes and game states.  A pool is not
+/// thread-safe, but its budget may be shared between threads.
+template <class T>
+class NodePool {
+public:
+  // Free nodes kept without a budget, so that memory doesn't stay at the
+  // peak tree size for the life of the process.
+  constexpr static size_t DEFAULT_MAX_FREE = 100000;
+
+private:
+  struct Storage {
+    std::vector<std::unique_ptr<T>> free_nodes;
+    size_t max_free = DEFAULT_MAX_FREE;
+    // Nodes handed out by this pool that are still live.
+    long num_live = 0;
+  };
+
+  struct Recycler {
+    std::shared_ptr<Storage> storage;
+    std::shared_ptr<NodeBudget> budget;
+
+    void operator()(T* node) const {
+      // Releasing a node's children recycles them first.
+      node->release();
+      if (budget)
+        budget->remove();
+      --storage->num_live;
+      if (storage->free_nodes.size() < storage->max_free)
+        storage->free_nodes.emplace_back(node);
+      else
+        delete node;
+    }
+  };
+
+  // Shared with the deleters, so that nodes can outlive the pool.
+  std::shared_ptr<Storage> storage = std::make_shared<Storage>();
+  std::shared_ptr<NodeBudget> node_budget;
+
+public:
+  template <class... Args>
+  std::shared_ptr<T> make(Args&&... args) {
+    T* node;
+    if (storage->free_nodes.empty()) {
+      node = new T(std::forward<Args>(args)...);
+    }
+    else {
+      node = storage->free_nodes.back().release();
+      storage->free_nodes.pop_back();
+      node->init(std::forward<Args>(args)...);
+    }
+    if (node_budget)
+      node_budget->add();
+    ++storage->num_live;
+    return std::shared_ptr<T>(node, Recycler{storage, node_budget});
+  }
+
+  void set_budget(std::shared_ptr<NodeBudget> budget) {
+    node_budget = budget;
+    set_max_free(budget ? budget->limit() : DEFAULT_MAX_FREE);
+  }
+  const std::shared_ptr<NodeBudget>& budget() const { return node_budget; }
+
+  bool exhausted() const { return node_budget && node_budget->exhausted(); }
+
+  /// Number of live nodes from this pool.  Less than the budget's size when
+  /// the budget is shared.
+  long size() const { return storage->num_live; }
+
+  /// Size to prune this pool's nodes down to, so that the budget falls to
+  /// `fraction` of its limit if every pool sharing it prunes its share in
+  /// proportion to its size.  Requires a budget.
+  long prune_target(float fraction) const {
+    auto total = node_budget->size();
+    if (total <= 0)
+      return 0;
+    return static_cast<long>(fraction * node_budget->limit() * size() / total);
+  }
+
+  /// Number of released nodes waiting to be reused.
+  size_t num_free() const { return storage->free_nodes.size(); }
+
+  /// Most released nodes to keep for reuse.  Extra free nodes are deleted.
+  size_t max_free() const { return storage->max_free; }
+  void set_max_free(size_t max_free) {
+    storage->max_free = max_free;
+    if (storage->free_nodes.size() > max_free)
+      storage->free_nodes.resize(max_free);
+  }
+};
+
+#endif // NODE_POOL_H
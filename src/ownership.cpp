@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <unordered_set>
+
+#include "ownership.h"
+#include "agent_naive.h"
+
+
+namespace {
+  /// Add the owner of each point at the end of a playout: the color of a
+  /// stone, or of all the neighbors of an empty point.
+  void add_final_ownership(const Board& board, std::vector<int>& counts) {
+    for (int r=1; r <= board.num_rows; ++r) {
+      for (int c=1; c <= board.num_cols; ++c) {
+        auto point = Point(r, c);
+        auto owner = board.get(point);
+        if (! owner) {
+          for (const auto& neighbor : point.neighbors()) {
+            if (! board.is_on_grid(neighbor))
+              continue;
+            auto color = board.get(neighbor);
+            if (! color || (owner && color != owner)) {
+              owner.reset();
+              break;
+            }
+            owner = color;
+          }
+        }
+        if (owner)
+          counts[(r - 1) * board.num_cols + c - 1] += owner == Player::black ? 1 : -1;
+      }
+    }
+  }
+}
+
+
+OwnershipEstimate::OwnershipEstimate(const GameState& game_state, int num_playouts, int num_threads) :
+  num_rows(game_state.board->num_rows), num_cols(game_state.board->num_cols),
+  ownership(num_rows * num_cols), board(game_state.board) {
+  // Playouts start from a copy of the position without its history, so that
+  // a finished game (two passes) is played on.  Komi doesn't affect the
+  // playouts.
+  auto start = std::make_shared<const GameState>(std::make_shared<Board>(*game_state.board),
+                                                 game_state.next_player, nullptr, std::nullopt,
+                                                 0.0);
+  // Random games rarely run this long, but without superko checks they
+  // aren't guaranteed to end.
+  const int max_moves = 3 * num_rows * num_cols;
+
+  std::vector<std::vector<int>> counts(num_threads, std::vector<int>(num_rows * num_cols));
+  std::vector<unsigned> seeds(num_threads);
+  for (auto& seed : seeds)
+    seed = rng();
+  std::vector<std::thread> threads;
+  for (int t=0; t<num_threads; ++t) {
+    threads.emplace_back([&, t]() {
+      FastRandomBot bot(seeds[t]);
+      for (int i=t; i<num_playouts; i+=num_threads) {
+        ConstGameStatePtr game = start;
+        for (int m=0; m<max_moves && ! game->is_over(); ++m)
+          game = game->apply_move(bot.select_move(*game));
+        add_final_ownership(*game->board, counts[t]);
+      }
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+
+  for (const auto& thread_counts : counts) {
+    for (size_t i=0; i<ownership.size(); ++i)
+      ownership[i] += static_cast<float>(thread_counts[i]) / num_playouts;
+  }
+}
+
+
+bool OwnershipEstimate::is_dead(const GoString& string) const {
+  float total = 0.0;
+  for (const auto& point : string.stones)
+    total += get(point);
+  auto mean = total / string.stones.size();
+  return string.color == Player::black ? mean < -DEAD_THRESHOLD : mean > DEAD_THRESHOLD;
+}
+
+
+std::vector<std::vector<Point>> OwnershipEstimate::strings(bool dead) const {
+  std::vector<std::vector<Point>> strings;
+  std::unordered_set<const GoString*> visited;
+  for (int r=1; r <= num_rows; ++r) {
+    for (int c=1; c <= num_cols; ++c) {
+      auto string = board->get_go_string(Point(r, c));
+      if (! string || ! visited.insert(string->get()).second || is_dead(**string) != dead)
+        continue;
+      std::vector<Point> stones((*string)->stones.begin(), (*string)->stones.end());
+      std::sort(stones.begin(), stones.end());
+      strings.push_back(std::move(stones));
+    }
+  }
+  return strings;
+}
+
+
+ConstBoardPtr OwnershipEstimate::without_dead_stones() const {
+  // Removing dead stones only adds liberties, so placing the live stones in
+  // any order captures nothing.
+  auto cleaned = std::make_shared<Board>(num_rows, num_cols);
+  for (const auto& string : live_strings()) {
+    auto color = board->get(string.front()).value();
+    for (auto point : string)
+      cleaned->place_stone(color, point);
+  }
+  return cleaned;
+}
@@ -0,0 +1,50 @@
+#ifndef OWNERSHIP_H
+#define OWNERSHIP_H
+
+#include <vector>
+
+#include "goboard.h"
+#include "scoring.h"
+
+/// Ownership of each point estimated from random playouts, used to find dead
+/// stones for scoring.
+class OwnershipEstimate {
+  int num_rows, num_cols;
+  // Mean ownership of each point, row-major, from 1 for black to -1 for
+  // white.
+  std::vector<float> ownership;
+  ConstBoardPtr board;
+
+  // A string is dead if its stones are owned by the opponent in most
+  // playouts.
+  constexpr static float DEAD_THRESHOLD = 0.0;
+
+public:
+  /// Play num_playouts random games to the end from the position, split over
+  /// num_threads threads.  Random moves don't fill their own eyes, so the end
+  /// of a playout can be scored point by point.
+  OwnershipEstimate(const GameState& game_state, int num_playouts, int num_threads = 1);
+
+  float get(Point point) const {
+    return ownership[(point.row - 1) * num_cols + point.col - 1];
+  }
+
+  /// Strings on the board that are dead, or alive, as lists of their
+  /// stones, ordered by their first stone.
+  std::vector<std::vector<Point>> dead_strings() const { return strings(true); }
+  std::vector<std::vector<Point>> live_strings() const { return strings(false); }
+
+  /// The board with dead stones removed, so that area scoring counts their
+  /// points for the opponent.
+  ConstBoardPtr without_dead_stones() const;
+
+  GameResult score(float komi) const {
+    return GameResult(without_dead_stones(), komi);
+  }
+
+private:
+  bool is_dead(const GoString& string) const;
+  std::vector<std::vector<Point>> strings(bool dead) const;
+};
+
+#endif // OWNERSHIP_H
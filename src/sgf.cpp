@@ -0,0 +1,94 @@
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "sgf.h"
+
+namespace {
+  /// SGF point, with rows counted from the top, or pass.
+  Move parse_sgf_move(const std::string& value, int board_size) {
+    if (value.empty() || (value == "tt" && board_size <= 19))
+      return Move::pass();
+    if (value.size() != 2)
+      throw std::runtime_error("invalid SGF move: " + value);
+    auto col = value[0] - 'a' + 1;
+    auto row = board_size - (value[1] - 'a');
+    if (col < 1 || col > board_size || row < 1 || row > board_size)
+      throw std::runtime_error("SGF move off the board: " + value);
+    return Move::play(Point(row, col));
+  }
+}
+
+
+SgfGame parse_sgf(const std::string& text) {
+  SgfGame game;
+  auto pos = text.find('(');
+  if (pos == std::string::npos)
+    throw std::runtime_error("SGF game tree not found");
+  ++pos;
+
+  std::string property;
+  // Moves are converted with the board size from SZ, which is in the root
+  // node before any moves.
+  while (pos < text.size()) {
+    auto c = text[pos];
+    if (c == ')')
+      // The first variation has ended, and what follows are alternatives.
+      break;
+    if (c == '[') {
+      std::string value;
+      ++pos;
+      while (pos < text.size() && text[pos] != ']') {
+        if (text[pos] == '\\')
+          ++pos;
+        if (pos < text.size())
+          value += text[pos];
+        ++pos;
+      }
+      if (pos == text.size())
+        throw std::runtime_error("unterminated SGF property value");
+      ++pos;
+
+      try {
+        if (property == "SZ")
+          game.board_size = std::stoi(value);
+        else if (property == "KM")
+          game.komi = std::stof(value);
+      }
+      catch (const std::logic_error&) {
+        throw std::runtime_error("invalid SGF value for " + property + ": " + value);
+      }
+      if (property == "B" || property == "W") {
+        auto player = property == "B" ? Player::black : Player::white;
+        game.moves.emplace_back(player, parse_sgf_move(value, game.board_size));
+      }
+      else if (property == "AB" || property == "AW" || property == "AE")
+        game.has_setup = true;
+      continue;
+    }
+    if (std::isupper(c)) {
+      property.clear();
+      while (pos < text.size() && std::isalpha(text[pos])) {
+        // Lowercase letters were allowed in old identifiers, and are ignored.
+        if (std::isupper(text[pos]))
+          property += text[pos];
+        ++pos;
+      }
+      continue;
+    }
+    // Node separators, the start of the first variation and whitespace.
+    ++pos;
+  }
+  return game;
+}
+
+
+SgfGame load_sgf(const std::string& path) {
+  std::ifstream fin(path);
+  if (! fin)
+    throw std::runtime_error("unable to read SGF file: " + path);
+  std::stringstream ss;
+  ss << fin.rdbuf();
+  return parse_sgf(ss.str());
+}
@@ -0,0 +1,29 @@
+#ifndef SGF_H
+#define SGF_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gotypes.h"
+#include "goboard.h"
+
+/// Game record read from the main line of an SGF file.  Only the properties
+/// needed to replay the game are kept.
+struct SgfGame {
+  int board_size = 19;
+  float komi = 7.5;
+  std::vector<std::pair<Player, Move>> moves;
+  // True if the record places stones with AB, AW or AE (e.g., handicap
+  // stones), which can't be replayed as moves.
+  bool has_setup = false;
+};
+
+/// Parse the main line of an SGF game: the first variation at every branch.
+/// Throws std::runtime_error if the text is malformed.
+SgfGame parse_sgf(const std::string& text);
+
+/// Read and parse an SGF file.  Throws std::runtime_error on failure.
+SgfGame load_sgf(const std::string& path);
+
+#endif // SGF_H
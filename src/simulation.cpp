@@ -26,8 +26,9 @@ std::pair<Player, int> simulate_game(int board_size,
     ++move_count;
   }
 
-  auto game_result = GameResult(game->board);
-  auto winner = game_result.winner();
+  // Use the game state's winner when the game is over so that resignation is
+  // accounted for.
+  auto winner = game->is_over() ? game->winner().value() : GameResult(game->board).winner();
   if (verbosity >= 1) {
     std::cout << move_count << " moves\n";
     std::cout << "Winner: " << winner << std::endl;
@@ -1,19 +1,41 @@
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/benchmark/catch_benchmark.hpp>
 
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <thread>
+
 #include "gotypes.h"
 #include "goboard.h"
 #include "agent_helpers.h"
+#include "agent_naive.h"
 // #include "utils.h"
 #include "gtp/command.h"
+#include "gtp/frontend.h"
 #include "gtp/response.h"
+#include "gtp/time_control.h"
 #include "scoring.h"
+#include "sgf.h"
 #include "eval.h"
 #include "alphabeta.h"
 #include "mcts.h"
+#include "node_pool.h"
+#include "ownership.h"
+#include "uct_kernel.h"
+#include "utils.h"
 #include "zero/encoder.h"
 #include "zero/agent_zero.h"
+#include "zero/batching_evaluator.h"
 #include "zero/dihedral.h"
+#include "zero/evaluator.h"
+#include "zero/torchscript_evaluator.h"
+#include "zero/native_net.h"
+#include "zero/model_loader.h"
+#include "zero/tuning.h"
+#include "zero/resignation.h"
 
 TEST_CASE( "Check colors", "[colors]" ) {
 
@@ -92,6 +114,34 @@ TEST_CASE( "Test capture liberties", "[liberties]" ) {
 }
 
 
+TEST_CASE( "Incremental liberty planes", "[liberties]" ) {
+  // Play out random games and compare the incrementally maintained planes
+  // against the go strings.
+  auto bot = FastRandomBot();
+  for (auto game_num=0; game_num<5; ++game_num) {
+    auto game = GameState::new_game(9);
+    while (! game->is_over()) {
+      game = game->apply_move(bot.select_move(*game));
+      const auto& planes = game->board->get_liberty_planes();
+      for (auto r=1; r<=9; ++r) {
+        for (auto c=1; c<=9; ++c) {
+          auto plane = planes[(r - 1) * 9 + c - 1];
+          auto go_string = game->board->get_go_string(Point(r, c));
+          if (! go_string)
+            REQUIRE( plane == 0 );
+          else {
+            auto expected = std::min(4, go_string.value()->num_liberties());
+            if (go_string.value()->color == Player::white)
+              expected += 4;
+            REQUIRE( plane == expected );
+          }
+        }
+      }
+    }
+  }
+}
+
+
 TEST_CASE( "Test game state", "[gamestate]" ) {
   auto game = GameState::new_game(19);
   REQUIRE( ! game->is_over() );
@@ -237,6 +287,10 @@ TEST_CASE( "Test GTP command parsing", "[gtp]" ) {
   response = gtp::Response::success();
   REQUIRE( response.serialize(command) == "= \n\n" );
 
+  // Streamed responses are ended separately.
+  command = gtp::parse_command("7 lz-analyze 10");
+  response = gtp::Response::stream();
+  REQUIRE( response.serialize(command) == "=7\n" );
 }
 
 
@@ -275,6 +329,37 @@ TEST_CASE( "Test scoring", "[scoring]" ) {
 }
 
 
+TEST_CASE( "Ownership from random playouts", "[scoring]" ) {
+  // ..bw.
+  // ..bw.
+  // w.bw.
+  // ..bw.
+  // ..bw.
+  auto game = GameState::new_game(5);
+  for (int r=1; r<=5; ++r) {
+    game->board->place_stone(Player::black, Point(r, 3));
+    game->board->place_stone(Player::white, Point(r, 4));
+  }
+  game->board->place_stone(Player::white, Point(3, 1));
+
+  auto ownership = OwnershipEstimate(*game, 400, 2);
+  REQUIRE( ownership.get(Point(1, 1)) > 0.0 );
+  REQUIRE( ownership.get(Point(3, 1)) > 0.0 );
+  REQUIRE( ownership.get(Point(1, 5)) < 0.0 );
+
+  auto dead = ownership.dead_strings();
+  REQUIRE( dead.size() == 1 );
+  REQUIRE( dead[0] == std::vector<Point>{Point(3, 1)} );
+  REQUIRE( ownership.live_strings().size() == 2 );
+
+  // The dead stone's point counts for black.
+  auto result = ownership.score(0.5);
+  REQUIRE( result.black == 15 );
+  REQUIRE( result.white == 10 );
+  REQUIRE( result.winner() == Player::black );
+}
+
+
 TEST_CASE( "Benchmark alpha beta", "[!benchmark][alphabeta]" ) {
 
   const int MIN_SCORE = -999999;
@@ -311,6 +396,45 @@ TEST_CASE( "Benchmark MCTS", "[!benchmark][mctsbench]" ) {
 }
 
 
+TEST_CASE( "Vectorized child selection", "[uct]" ) {
+  std::default_random_engine engine(0);
+  std::uniform_real_distribution<float> uniform(0.0, 1.0);
+  std::uniform_int_distribution<int> counts(0, 50);
+
+  // Cover partial vector blocks as well as a full 19x19 set of branches.
+  for (int num_branches : {1, 7, 8, 9, 17, 82, 362}) {
+    std::vector<float> priors, total_values;
+    std::vector<int> visit_counts, wins, rollouts;
+    for (int i=0; i<num_branches; ++i) {
+      priors.push_back(uniform(engine));
+      visit_counts.push_back(counts(engine));
+      total_values.push_back(visit_counts.back() * (2.0 * uniform(engine) - 1.0));
+      rollouts.push_back(counts(engine) + 1);
+      wins.push_back(rollouts.back() * uniform(engine));
+    }
+    REQUIRE( select_puct(priors.data(), visit_counts.data(), total_values.data(), num_branches, 30.0) ==
+             select_puct_scalar(priors.data(), visit_counts.data(), total_values.data(), num_branches, 30.0) );
+    REQUIRE( select_uct(wins.data(), rollouts.data(), num_branches, 1.5, 7.0) ==
+             select_uct_scalar(wins.data(), rollouts.data(), num_branches, 1.5, 7.0) );
+
+    // Ties resolve to the first branch:
+    std::vector<float> equal_priors(num_branches, 0.5);
+    std::vector<int> zero_counts(num_branches, 0);
+    std::vector<float> zero_values(num_branches, 0.0);
+    REQUIRE( select_puct(equal_priors.data(), zero_counts.data(), zero_values.data(), num_branches, 1.0) == 0 );
+
+    // So does a set of branches where no score beats the minimum:
+    std::vector<float> nan_priors(num_branches, std::nanf(""));
+    std::vector<float> lost_values(num_branches, -std::numeric_limits<float>::infinity());
+    REQUIRE( select_puct(nan_priors.data(), zero_counts.data(), zero_values.data(), num_branches, 1.0) == 0 );
+    REQUIRE( select_puct_scalar(nan_priors.data(), zero_counts.data(), zero_values.data(), num_branches, 1.0) == 0 );
+    REQUIRE( select_puct(equal_priors.data(), visit_counts.data(), lost_values.data(), num_branches, 1.0) == 0 );
+    REQUIRE( select_uct(wins.data(), rollouts.data(), num_branches, std::nanf(""), 7.0) == 0 );
+    REQUIRE( select_uct_scalar(wins.data(), rollouts.data(), num_branches, std::nanf(""), 7.0) == 0 );
+  }
+}
+
+
 TEST_CASE( "Benchmark simulate game", "[!benchmark][simgame]" ) {
   auto game = GameState::new_game(9);
   BENCHMARK("Simulate game") {
@@ -349,6 +473,8 @@ TEST_CASE( "Simple encoder", "[encoder]") {
   REQUIRE( encoder.decode_move_index(9*9).is_pass );
   REQUIRE( encoder.decode_move_index(0).point.value() == Point(1, 1) );
   REQUIRE( encoder.decode_move_index(9).point.value() == Point(2, 1) );
+  for (auto i=0; i<encoder.num_moves(); ++i)
+    REQUIRE( encoder.encode_move(encoder.decode_move_index(i)) == i );
 
   auto game = GameState::new_game(9);
   auto tensor = encoder.encode(*game);
@@ -361,6 +487,13 @@ TEST_CASE( "Simple encoder", "[encoder]") {
       }
     }
   }
+
+  // Encoding into a reused buffer must overwrite all previous contents:
+  game = game->apply_move(Move::play(Point(3, 3)));
+  std::vector<float> buffer(encoder.input_size(), 7.0);
+  encoder.encode_into(*game, buffer.data());
+  auto expected = encoder.encode(*game);
+  REQUIRE( torch::equal(torch::from_blob(buffer.data(), encoder.input_shape()), expected) );
 }
 
 TEST_CASE( "Benchmark zero move", "[!benchmark][zeromove]" ) {
@@ -381,7 +514,8 @@ TEST_CASE( "Benchmark zero move", "[!benchmark][zeromove]" ) {
   }
 
   auto encoder = std::make_shared<SimpleEncoder>(board_size);
-  auto agent = ZeroAgent(model, encoder, num_rounds);
+  auto evaluator = std::make_shared<TorchScriptEvaluator>(model, encoder->input_shape());
+  auto agent = ZeroAgent(evaluator, encoder, num_rounds);
 
   auto game = GameState::new_game(9);
   BENCHMARK("Zero Move") {
@@ -405,4 +539,1096 @@ TEST_CASE( "Dihedral transformations", "[dihedral]" ) {
   auto rand = Dihedral();
   REQUIRE( torch::equal(rand.inverse(rand.forward(x)), x) );
 
+  // Point tables must agree with the tensor transformations:
+  for (auto board_size : {2, 5, 9, 19}) {
+    auto board = torch::reshape(torch::arange(0, board_size * board_size), {1, board_size, board_size});
+    for (auto i=0; i<8; ++i) {
+      auto transform = Dihedral(i % 4, i > 3);
+      auto transformed = transform.forward(board).reshape({board_size * board_size});
+      const auto& point_map = transform.point_map(board_size);
+      for (auto p=0; p<board_size * board_size; ++p)
+        REQUIRE( transformed[point_map[p]].item<int64_t>() == p );
+    }
+  }
+}
+
+
+TEST_CASE( "Transformed encoding", "[dihedral]" ) {
+  auto encoder = SimpleEncoder(5);
+  auto game = GameState::new_game(5);
+  game = game->apply_move(Move::play(Point(1, 2)));
+  game = game->apply_move(Move::play(Point(2, 2)));
+  game = game->apply_move(Move::play(Point(4, 5)));
+
+  auto original = encoder.encode(*game);
+  std::vector<float> buffer(encoder.input_size());
+  std::vector<float> policy(encoder.num_moves());
+  std::vector<float> transformed_policy(encoder.num_moves());
+  std::vector<float> restored_policy(encoder.num_moves());
+  for (auto i=0; i<encoder.num_moves(); ++i)
+    policy[i] = i;
+
+  for (auto i=0; i<8; ++i) {
+    auto transform = Dihedral(i % 4, i > 3);
+    encoder.encode_into(*game, buffer.data(), transform);
+    REQUIRE( torch::equal(torch::from_blob(buffer.data(), encoder.input_shape()),
+                          transform.forward(original)) );
+
+    // A policy in the original frame, as the network would produce it for the
+    // transformed input:
+    const auto& point_map = transform.point_map(5);
+    for (auto p=0; p<25; ++p)
+      transformed_policy[point_map[p]] = policy[p];
+    transformed_policy[25] = policy[25];
+    encoder.untransform_policy(transformed_policy.data(), transform, restored_policy.data());
+    REQUIRE( restored_policy == policy );
+  }
+}
+
+TEST_CASE( "Resignation threshold calibration", "[resign]" ) {
+  // Play through every game so that each one is used for calibration.
+  ResignationManager manager(-0.9, 1.0, 0.1, 100);
+
+  REQUIRE( ! manager.begin_game().has_value() );
+  manager.complete_game(-0.95);
+  // A single game isn't enough to tune the threshold.
+  REQUIRE( manager.get_threshold() == -0.9f );
+  REQUIRE( manager.false_positive_rate() == 1.0f );
+
+  // Winners' minimum values of -0.99, -0.98, ..., 0.0
+  for (int i=0; i<100; ++i) {
+    manager.begin_game();
+    manager.complete_game(-0.99 + 0.01 * i);
+  }
+  // The first game has dropped out of the window, so 10% of the recent
+  // winners fall below -0.89.
+  REQUIRE( std::abs(manager.get_threshold() + 0.89f) < 1e-5 );
+  REQUIRE( manager.get_num_playthrough_games() == 101 );
+
+  // Threshold is never set above an even position.
+  for (int i=0; i<100; ++i) {
+    manager.begin_game();
+    manager.complete_game(0.5);
+  }
+  REQUIRE( manager.get_threshold() == 0.0f );
+
+  ResignationManager no_playthrough(-0.8, 0.0);
+  REQUIRE( no_playthrough.begin_game() == -0.8f );
+  no_playthrough.complete_game(-0.95);
+  REQUIRE( no_playthrough.get_num_playthrough_games() == 0 );
+}
+
+TEST_CASE( "Lazy node expansion", "[zero]" ) {
+  auto encoder = SimpleEncoder(5);
+  auto game = GameState::new_game(5);
+  game = game->apply_move(Move::play(Point(1, 1)));
+  game = game->apply_move(Move::play(Point(1, 2)));
+  game = game->apply_move(Move::play(Point(2, 2)));
+
+  std::vector<float> priors(encoder.num_moves());
+  std::mt19937 engine(7);
+  std::uniform_real_distribution<float> uniform(0.0, 1.0);
+  for (auto& p : priors)
+    p = uniform(engine);
+  // Make occupied points attractive so that they have to be skipped.
+  priors[encoder.encode_move(Move::play(Point(1, 1)))] = 2.0;
+
+  auto full = ZeroNode(game, 0.0, priors.data(), encoder, false);
+  auto lazy = ZeroNode(game, 0.0, priors.data(), encoder, false, false);
+  REQUIRE( full.num_branches() == game->legal_moves().size() - 1 );
+  REQUIRE( lazy.num_branches() == 1 );
+
+  // Widening adds the legal moves in order of decreasing prior.
+  while (lazy.widen(encoder));
+  REQUIRE( lazy.num_branches() == full.num_branches() );
+  for (auto i=1; i<lazy.num_branches(); ++i)
+    REQUIRE( lazy.priors[i - 1] >= lazy.priors[i] );
+  for (auto move : lazy.moves) {
+    REQUIRE( game->is_valid_move(move) );
+    REQUIRE( full.branch_index(move) >= 0 );
+  }
+}
+
+TEST_CASE( "Priors of proven losses", "[zero]" ) {
+  auto encoder = SimpleEncoder(5);
+  auto game = GameState::new_game(5);
+  std::vector<float> priors(encoder.num_moves(), 1.0f / encoder.num_moves());
+  priors[encoder.encode_move(Move::play(Point(3, 3)))] = 0.5;
+
+  auto node = ZeroNode(game, 0.0, priors.data(), encoder, false);
+  auto branch = node.branch_index(Move::play(Point(3, 3)));
+  auto child_state = game->apply_move(Move::play(Point(3, 3)));
+  node.children[branch] = std::make_shared<ZeroNode>(child_state, 0.0, priors.data(), encoder, false);
+  node.children[branch]->proof = Proof::win;
+  REQUIRE( ! node.update_proof(branch) );
+
+  // The lost branch is no longer explored, but keeps its prior for analysis.
+  REQUIRE( node.priors[branch] == 0.0 );
+  REQUIRE( node.prior(branch) == 0.5 );
+  REQUIRE( node.prior(branch + 1) == node.priors[branch + 1] );
+  REQUIRE( ! node.update_proof(branch) );
+  REQUIRE( node.prior(branch) == 0.5 );
+}
+
+TEST_CASE( "Position keys for transpositions", "[zero]" ) {
+  auto play = [](GameStatePtr game, std::vector<Point> points) {
+    for (auto point : points)
+      game = game->apply_move(Move::play(point));
+    return game;
+  };
+
+  auto game = GameState::new_game(5);
+  auto a = play(game, {Point(1, 1), Point(3, 3), Point(2, 2)});
+  auto b = play(game, {Point(2, 2), Point(3, 3), Point(1, 1)});
+  REQUIRE( PositionKey(*a) == PositionKey(*b) );
+  REQUIRE( PositionKeyHash()(PositionKey(*a)) == PositionKeyHash()(PositionKey(*b)) );
+
+  // Same stones with the other player to move:
+  auto c = play(game, {Point(1, 1), Point(3, 3)})->apply_move(Move::pass())->apply_move(Move::play(Point(2, 2)));
+  REQUIRE( ! (PositionKey(*a) == PositionKey(*c)) );
+
+  // A pass is distinguished, since a second pass ends the game.
+  auto d = play(game, {Point(1, 1), Point(3, 3)})->apply_move(Move::pass());
+  auto e = play(game, {Point(1, 1)})->apply_move(Move::pass())->apply_move(Move::play(Point(3, 3)));
+  REQUIRE( d->is_last_move_pass() );
+  REQUIRE( ! e->is_last_move_pass() );
+  REQUIRE( ! (PositionKey(*d) == PositionKey(*e)) );
+
+  // Ko: white captures at (2, 3), after which black can't immediately retake.
+  auto ko = play(game, {Point(1, 2), Point(1, 3), Point(2, 1), Point(2, 4),
+                        Point(3, 2), Point(3, 3), Point(2, 3), Point(2, 2)});
+  REQUIRE( ko->ko_points() == std::vector<Point>{Point(2, 3)} );
+  REQUIRE( PositionKey(*ko).ko_points.size() == 1 );
+}
+
+TEST_CASE( "MCTS solver", "[mcts]" ) {
+  // White has passed and black is ahead, so passing wins immediately.
+  auto game = GameState::new_game(5);
+  game = game->apply_move(Move::play(Point(3, 3)));
+  game = game->apply_move(Move::pass());
+
+  auto agent = MCTSAgent(100000, 1.5);
+  REQUIRE( agent.select_move(*game) == Move::pass() );
+}
+
+TEST_CASE( "Zero agent with uniform evaluator", "[zero]" ) {
+  auto encoder = std::make_shared<SimpleEncoder>(5);
+  auto evaluator = std::make_shared<UniformEvaluator>(encoder->num_moves());
+  auto game = GameState::new_game(5);
+  game = game->apply_move(Move::play(Point(3, 3)));
+
+  SECTION( "tree search" ) {
+    auto agent = ZeroAgent(evaluator, encoder, 200);
+    REQUIRE( game->is_valid_move(agent.select_move(*game)) );
+    REQUIRE( agent.get_stats().num_rounds == 200 );
+  }
+
+  SECTION( "graph search" ) {
+    auto agent = ZeroAgent(evaluator, encoder, 2000);
+    agent.set_graph_search(true);
+    REQUIRE( game->is_valid_move(agent.select_move(*game)) );
+    const auto& stats = agent.get_stats();
+    REQUIRE( stats.num_transpositions > 0 );
+    REQUIRE( stats.num_evaluations <= 2001 );
+  }
+
+  SECTION( "Gumbel search" ) {
+    auto agent = ZeroAgent(evaluator, encoder, 64, false);
+    agent.set_gumbel(true, 8);
+    REQUIRE( game->is_valid_move(agent.select_move(*game)) );
+  }
+
+  SECTION( "early stopping" ) {
+    // One move is strongly preferred, so the search is decided early.
+    class PeakedEvaluator : public Evaluator {
+      int num_moves;
+
+    public:
+      PeakedEvaluator(int num_moves) : num_moves(num_moves) {}
+
+      void evaluate(const float* input, int batch_size, float* priors, float* values) {
+        for (int b=0; b<batch_size; ++b) {
+          std::fill_n(priors + b * num_moves, num_moves, 0.1 / (num_moves - 1));
+          priors[b * num_moves] = 0.9;
+          values[b] = 0.0;
+        }
+      }
+    };
+    auto evaluator = std::make_shared<PeakedEvaluator>(encoder->num_moves());
+
+    auto agent = ZeroAgent(evaluator, encoder, 500);
+    agent.set_early_stopping(true);
+    agent.select_move(*game);
+    REQUIRE( agent.get_stats().rounds_saved > 0 );
+
+    // Searches recorded as policy targets always run in full.
+    auto recording_agent = ZeroAgent(evaluator, encoder, 500);
+    recording_agent.set_early_stopping(true);
+    auto collector = std::make_shared<ExperienceCollector>();
+    recording_agent.set_collector(collector);
+    collector->begin_episode();
+    recording_agent.select_move(*game);
+    REQUIRE( recording_agent.get_stats().num_rounds == 500 );
+    REQUIRE( recording_agent.get_stats().rounds_saved == 0 );
+  }
+
+  SECTION( "proven win" ) {
+    // White has passed and black is ahead, so passing wins immediately.
+    auto agent = ZeroAgent(evaluator, encoder, 1000);
+    REQUIRE( agent.select_move(*game->apply_move(Move::pass())) == Move::pass() );
+    REQUIRE( agent.get_stats().num_rounds < 1000 );
+  }
+}
+
+TEST_CASE( "Symmetry ensemble", "[zero]" ) {
+  // Priors follow the stones and favor low point indices, so that they
+  // depend on the orientation of the input.
+  class FeatureEvaluator : public Evaluator {
+    int num_points;
+    int num_planes;
+
+  public:
+    FeatureEvaluator(int num_points, int num_planes) : num_points(num_points), num_planes(num_planes) {}
+
+    void evaluate(const float* input, int batch_size, float* priors, float* values) {
+      for (int b=0; b<batch_size; ++b) {
+        auto features = input + b * num_planes * num_points;
+        auto policy = priors + b * (num_points + 1);
+        float total = 1.0;
+        policy[num_points] = 1.0;
+        for (int i=0; i<num_points; ++i) {
+          policy[i] = 1.0 + 2.0 * i / num_points;
+          for (int plane=0; plane<num_planes; ++plane)
+            policy[i] += features[plane * num_points + i];
+          total += policy[i];
+        }
+        for (int i=0; i<=num_points; ++i)
+          policy[i] /= total;
+        values[b] = 0.0;
+      }
+    }
+  };
+
+  auto encoder = std::make_shared<SimpleEncoder>(5);
+  auto evaluator = std::make_shared<FeatureEvaluator>(25, encoder->input_shape()[0]);
+  auto game = GameState::new_game(5);
+  game = game->apply_move(Move::play(Point(1, 2)));
+  game = game->apply_move(Move::play(Point(2, 4)));
+
+  // Mean of the evaluations of each symmetry, transformed back.
+  std::vector<float> input(encoder->input_size());
+  std::vector<float> priors(encoder->num_moves()), untransformed(encoder->num_moves());
+  std::vector<float> expected(encoder->num_moves()), identity(encoder->num_moves());
+  float value;
+  for (int i=0; i<8; ++i) {
+    Dihedral transform(i % 4, i > 3);
+    encoder->encode_into(*game, input.data(), transform);
+    evaluator->evaluate(input.data(), 1, priors.data(), &value);
+    encoder->untransform_policy(priors.data(), transform, untransformed.data());
+    for (int j=0; j<encoder->num_moves(); ++j)
+      expected[j] += untransformed[j] / 8;
+    if (i == 0)
+      identity = untransformed;
+  }
+  float max_difference = 0.0;
+  for (int j=0; j<encoder->num_moves(); ++j)
+    max_difference = std::max(max_difference, std::abs(expected[j] - identity[j]));
+  REQUIRE( max_difference > 1e-3 );
+
+  auto agent = ZeroAgent(evaluator, encoder, 2000);
+  agent.set_symmetry_ensemble(true);
+  auto analysis = agent.analyze_position(*game);
+  REQUIRE( analysis.size() > 10 );
+  for (const auto& move : analysis)
+    REQUIRE( std::abs(move.prior - expected[encoder->encode_move(move.move)]) < 1e-5 );
+}
+
+TEST_CASE( "Playout cap randomization", "[zero]" ) {
+  auto encoder = std::make_shared<SimpleEncoder>(5);
+  auto evaluator = std::make_shared<UniformEvaluator>(encoder->num_moves());
+  auto game = GameState::new_game(5);
+
+  auto play = [&](float full_search_probability, bool record_fast_searches) {
+    auto agent = ZeroAgent(evaluator, encoder, 100);
+    agent.set_playout_cap(10, full_search_probability, record_fast_searches);
+    auto collector = std::make_shared<ExperienceCollector>();
+    agent.set_collector(collector);
+    collector->begin_episode();
+    auto state = game;
+    for (int i=0; i<4; ++i)
+      state = state->apply_move(agent.select_move(*state));
+    collector->complete_episode(1.0);
+    REQUIRE( agent.get_stats().num_moves == 4 );
+    return std::make_pair(collector->full_search, agent.get_stats());
+  };
+
+  // Fast searches are only recorded as value-only positions.
+  auto [fast_recorded, fast_stats] = play(0.0, true);
+  REQUIRE( fast_recorded == std::vector<float>(4, 0.0) );
+  REQUIRE( fast_stats.num_full_searches == 0 );
+
+  auto [fast_skipped, skipped_stats] = play(0.0, false);
+  REQUIRE( fast_skipped.empty() );
+
+  auto [full_recorded, full_stats] = play(1.0, true);
+  REQUIRE( full_recorded == std::vector<float>(4, 1.0) );
+  REQUIRE( full_stats.num_full_searches == 4 );
+}
+
+TEST_CASE( "Gumbel sequential halving", "[zero]" ) {
+  auto encoder = std::make_shared<SimpleEncoder>(5);
+  auto evaluator = std::make_shared<UniformEvaluator>(encoder->num_moves());
+
+  SECTION( "visit schedule" ) {
+    // 64 rounds over 8 moves in 3 phases: 2 rounds for each of 8 moves, 5
+    // for each of the best 4, 10 for each of the best 2, and the remaining 8
+    // for the best move.
+    auto agent = ZeroAgent(evaluator, encoder, 64);
+    agent.set_gumbel(true, 8);
+    auto analysis = agent.analyze_position(*GameState::new_game(5));
+    std::vector<int> visits;
+    for (const auto& move : analysis)
+      visits.push_back(move.visits);
+    REQUIRE( visits == std::vector<int>{25, 17, 7, 7, 2, 2, 2, 2} );
+    REQUIRE( agent.get_stats().num_rounds == 64 );
+  }
+
+  SECTION( "forced position" ) {
+    // White has passed.  Black's legal moves are to pass, which wins by 15
+    // points to 10.5, or to fill an eye, after which white can capture the
+    // black group.
+    // .bbww
+    // bbbw.
+    // bbbww
+    // bbbw.
+    // .bbww
+    auto game = GameState::new_game(5, 0.5);
+    for (int r=1; r<=5; ++r) {
+      for (int c=1; c<=5; ++c) {
+        if ((c == 1 && (r == 1 || r == 5)) || (c == 5 && (r == 2 || r == 4)) || (r == 3 && c == 2))
+          continue;
+        game->board->place_stone(c <= 3 ? Player::black : Player::white, Point(r, c));
+      }
+    }
+    game = game->apply_move(Move::play(Point(3, 2)))->apply_move(Move::pass());
+    // Two eye fills, pass and resign.
+    REQUIRE( game->legal_moves().size() == 4 );
+
+    auto agent = ZeroAgent(evaluator, encoder, 64);
+    agent.set_gumbel(true, 8);
+    REQUIRE( agent.select_move(*game) == Move::pass() );
+  }
+}
+
+
+TEST_CASE( "Record and replay evaluations", "[zero]" ) {
+  auto encoder = std::make_shared<SimpleEncoder>(5);
+  auto path = (std::filesystem::temp_directory_path() / "dlgo_test_evaluations.dat").string();
+
+  auto play = [&](std::shared_ptr<Evaluator> evaluator) {
+    // Fixed seed so that the random symmetries repeat.
+    rng.seed(42);
+    auto agent = ZeroAgent(evaluator, encoder, 50);
+    auto game = GameState::new_game(5);
+    std::vector<Move> moves;
+    for (auto i=0; i<4; ++i) {
+      moves.push_back(agent.select_move(*game));
+      game = game->apply_move(moves.back());
+    }
+    return moves;
+  };
+
+  auto uniform = std::make_shared<UniformEvaluator>(encoder->num_moves());
+  auto recorded = play(std::make_shared<RecordingEvaluator>(uniform, encoder->input_size(),
+                                                            encoder->num_moves(), path));
+  auto replayed = play(std::make_shared<ReplayEvaluator>(encoder->input_size(),
+                                                         encoder->num_moves(), path));
+  REQUIRE( recorded == replayed );
+
+  // A different search no longer matches the record.
+  auto replay = std::make_shared<ReplayEvaluator>(encoder->input_size(), encoder->num_moves(), path);
+  auto agent = ZeroAgent(replay, encoder, 50);
+  REQUIRE_THROWS( agent.select_move(*GameState::new_game(5)->apply_move(Move::pass())) );
+
+  // A record cut off partway through an evaluation is an error.
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - sizeof(float));
+  REQUIRE_THROWS( play(std::make_shared<ReplayEvaluator>(encoder->input_size(),
+                                                         encoder->num_moves(), path)) );
+
+  std::filesystem::remove(path);
+}
+
+namespace {
+
+  void randomize(std::vector<float>& values, size_t size, std::mt19937& gen) {
+    std::normal_distribution<float> dist(0.0, 0.1);
+    values.resize(size);
+    for (auto& v : values)
+      v = dist(gen);
+  }
+
+  ConvLayer random_conv(int in_channels, int out_channels, int kernel_size, std::mt19937& gen) {
+    ConvLayer layer{in_channels, out_channels, kernel_size};
+    randomize(layer.weights, out_channels * in_channels * kernel_size * kernel_size, gen);
+    randomize(layer.bias, out_channels, gen);
+    return layer;
+  }
+
+  DenseLayer random_dense(int in_features, int out_features, std::mt19937& gen) {
+    DenseLayer layer{in_features, out_features};
+    randomize(layer.weights, out_features * in_features, gen);
+    randomize(layer.bias, out_features, gen);
+    return layer;
+  }
+
+  torch::Tensor to_tensor(const std::vector<float>& values, at::IntArrayRef shape) {
+    return torch::from_blob(const_cast<float*>(values.data()), shape).clone();
+  }
+
+}
+
+TEST_CASE( "Native inference engine", "[native]" ) {
+  std::mt19937 gen(1);
+  const int grid = 9;
+  const int in_channels = 11;
+  const int filters = 64;
+
+  NativeNetWeights weights;
+  weights.in_channels = in_channels;
+  weights.grid_size = grid;
+  weights.tower.push_back(random_conv(in_channels, filters, 3, gen));
+  for (auto i=0; i<3; ++i)
+    weights.tower.push_back(random_conv(filters, filters, 3, gen));
+  weights.policy_conv = random_conv(filters, 2, 1, gen);
+  weights.policy_dense = random_dense(2 * grid * grid, grid * grid + 1, gen);
+  weights.value_conv = random_conv(filters, 1, 1, gen);
+  weights.value_hidden = random_dense(grid * grid, 256, gen);
+  weights.value_output = random_dense(256, 1, gen);
+
+  const int batch_size = 3;
+  std::vector<float> input;
+  randomize(input, batch_size * in_channels * grid * grid, gen);
+  // Encoder planes are binary.
+  for (auto& v : input)
+    v = v > 0;
+
+  // Reference forward pass with torch operations on the unfolded layers.
+  auto x = to_tensor(input, {batch_size, in_channels, grid, grid});
+  for (const auto& layer : weights.tower) {
+    weights.activation_ranges.push_back(x.max().item<float>());
+    auto w = to_tensor(layer.weights, {layer.out_channels, layer.in_channels, 3, 3});
+    x = torch::relu(torch::conv2d(x, w, to_tensor(layer.bias, {layer.out_channels}), {1}, {1}));
+  }
+  auto conv1x1 = [&](const ConvLayer& layer) {
+    auto w = to_tensor(layer.weights, {layer.out_channels, layer.in_channels, 1, 1});
+    return torch::flatten(torch::relu(torch::conv2d(x, w, to_tensor(layer.bias, {layer.out_channels}))), 1);
+  };
+  auto linear = [](const torch::Tensor& t, const DenseLayer& layer) {
+    auto w = to_tensor(layer.weights, {layer.out_features, layer.in_features});
+    return torch::linear(t, w, to_tensor(layer.bias, {layer.out_features}));
+  };
+  auto expected_priors = torch::softmax(linear(conv1x1(weights.policy_conv), weights.policy_dense), 1);
+  auto hidden = torch::relu(linear(conv1x1(weights.value_conv), weights.value_hidden));
+  auto expected_values = torch::tanh(linear(hidden, weights.value_output));
+
+  const int num_moves = grid * grid + 1;
+  std::vector<float> priors(batch_size * num_moves);
+  std::vector<float> values(batch_size);
+  NativeNet net(weights);
+  net.forward(input.data(), batch_size, priors.data(), values.data());
+
+  auto max_error = [](const std::vector<float>& actual, const torch::Tensor& expected) {
+    auto e = expected.contiguous();
+    float error = 0.0;
+    for (size_t i=0; i<actual.size(); ++i)
+      error = std::max(error, std::abs(actual[i] - e.data_ptr<float>()[i]));
+    return error;
+  };
+  // Summation order differs from torch, so results agree to rounding only.
+  REQUIRE( max_error(priors, expected_priors) < 1e-5 );
+  REQUIRE( max_error(values, expected_values) < 1e-5 );
+
+  SECTION( "Round trip through file" ) {
+    auto path = (std::filesystem::temp_directory_path() / "dlgo_test_native.bin").string();
+    weights.save(path);
+    REQUIRE( is_native_network_file(path) );
+
+    std::vector<float> loaded_priors(priors.size());
+    std::vector<float> loaded_values(values.size());
+    NativeNet loaded(NativeNetWeights::load(path));
+    loaded.forward(input.data(), batch_size, loaded_priors.data(), loaded_values.data());
+    REQUIRE( loaded_priors == priors );
+    REQUIRE( loaded_values == values );
+    REQUIRE( loaded.policy_size() == num_moves );
+
+    // The shared loader picks the native evaluator from the file header.
+    auto encoder = SimpleEncoder(grid);
+    auto evaluator = load_evaluator(path, encoder);
+    evaluator->evaluate(input.data(), batch_size, loaded_priors.data(), loaded_values.data());
+    REQUIRE( loaded_priors == priors );
+
+    std::filesystem::remove(path);
+  }
+
+  SECTION( "Int8 quantization" ) {
+    NativeNet quantized(weights, true);
+    std::vector<float> quantized_priors(priors.size());
+    std::vector<float> quantized_values(values.size());
+    quantized.forward(input.data(), batch_size, quantized_priors.data(), quantized_values.data());
+    for (auto b=0; b<batch_size; ++b) {
+      float distance = 0.0;
+      for (auto i=0; i<num_moves; ++i)
+        distance += std::abs(quantized_priors[b * num_moves + i] - priors[b * num_moves + i]);
+      REQUIRE( 0.5 * distance < 0.05 );
+      REQUIRE( std::abs(quantized_values[b] - values[b]) < 0.1 );
+    }
+
+    weights.activation_ranges.clear();
+    REQUIRE_THROWS_AS( NativeNet(weights, true), std::runtime_error );
+  }
+}
+
+TEST_CASE( "Corrupt native network files", "[zero]" ) {
+  std::mt19937 gen(1);
+  NativeNetWeights weights;
+  weights.in_channels = 2;
+  weights.grid_size = 3;
+  weights.tower.push_back(random_conv(2, 4, 3, gen));
+  weights.policy_conv = random_conv(4, 1, 1, gen);
+  weights.policy_dense = random_dense(9, 10, gen);
+  weights.value_conv = random_conv(4, 1, 1, gen);
+  weights.value_hidden = random_dense(9, 8, gen);
+  weights.value_output = random_dense(8, 1, gen);
+  weights.activation_ranges.push_back(1.0);
+
+  auto path = (std::filesystem::temp_directory_path() / "dlgo_test_corrupt.bin").string();
+  weights.save(path);
+  REQUIRE( NativeNetWeights::load(path).activation_ranges.size() == 1 );
+  auto size = std::filesystem::file_size(path);
+
+  // Each header dimension is bounded before anything is allocated.
+  auto overwrite_int = [&](int position, int32_t value) {
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(8 + 4 * position);
+    file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+  for (int position=0; position<8; ++position) {
+    weights.save(path);
+    overwrite_int(position, 1 << 30);
+    REQUIRE_THROWS_AS( NativeNetWeights::load(path), std::runtime_error );
+    overwrite_int(position, -1);
+    REQUIRE_THROWS_AS( NativeNetWeights::load(path), std::runtime_error );
+  }
+
+  // Files cut off in the header, the layers or the activation ranges.
+  for (auto cut : {size_t(20), size / 2, size - 2}) {
+    weights.save(path);
+    std::filesystem::resize_file(path, cut);
+    REQUIRE_THROWS_AS( NativeNetWeights::load(path), std::runtime_error );
+  }
+
+  std::filesystem::remove(path);
+}
+
+TEST_CASE( "Model loader errors", "[zero]" ) {
+  auto encoder = SimpleEncoder(9);
+  REQUIRE_THROWS_AS( load_evaluator("no_such_network.ts", encoder), std::runtime_error );
+
+  ModelLoadOptions options;
+  options.quantized = true;
+  REQUIRE_THROWS_AS( load_evaluator("no_such_network.ts", encoder, options), std::runtime_error );
+}
+
+TEST_CASE( "Tuning configuration file", "[tuning]" ) {
+  auto path = (std::filesystem::temp_directory_path() / "dlgo_test_tuning.conf").string();
+  TuningConfig config;
+  config.num_threads = 2;
+  config.num_workers = 6;
+  config.batch_size = 16;
+  config.save(path, "first line\nsecond line");
+
+  auto loaded = TuningConfig::load(path);
+  REQUIRE( loaded.num_threads == 2 );
+  REQUIRE( loaded.num_workers == 6 );
+  REQUIRE( loaded.batch_size == 16 );
+
+  std::ofstream(path) << "num_threads=4\nthreads=2\n";
+  REQUIRE_THROWS_AS( TuningConfig::load(path), std::runtime_error );
+  std::ofstream(path) << "num_threads=0\n";
+  REQUIRE_THROWS_AS( TuningConfig::load(path), std::runtime_error );
+
+  std::filesystem::remove(path);
+}
+
+namespace {
+
+  /// Records the largest number of live nodes seen at each evaluation.
+  class BudgetProbe : public Evaluator {
+    std::shared_ptr<Evaluator> evaluator;
+    std::shared_ptr<NodeBudget> budget;
+
+  public:
+    long max_nodes = 0;
+
+    BudgetProbe(std::shared_ptr<Evaluator> evaluator, std::shared_ptr<NodeBudget> budget) :
+      evaluator(evaluator), budget(budget) {}
+
+    void evaluate(const float* input, int batch_size, float* priors, float* values) {
+      max_nodes = std::max(max_nodes, budget->size());
+      evaluator->evaluate(input, batch_size, priors, values);
+    }
+  };
+
+}
+
+TEST_CASE( "Node budget", "[pool]" ) {
+  auto game = GameState::new_game(5);
+  auto budget = std::make_shared<NodeBudget>(100);
+
+  SECTION( "Zero agent" ) {
+    auto encoder = std::make_shared<SimpleEncoder>(5);
+    auto probe = std::make_shared<BudgetProbe>(std::make_shared<UniformEvaluator>(encoder->num_moves()),
+                                               budget);
+    auto agent = ZeroAgent(probe, encoder, 1000);
+    agent.set_node_budget(budget);
+    for (auto i=0; i<2; ++i) {
+      auto move = agent.select_move(*game);
+      REQUIRE( game->is_valid_move(move) );
+      game = game->apply_move(move);
+      // The tree is released after each move.
+      REQUIRE( budget->size() == 0 );
+    }
+    // The budget is checked before each round, which can add one node.
+    REQUIRE( probe->max_nodes <= budget->limit() );
+    REQUIRE( agent.get_stats().num_pruned > 0 );
+  }
+
+  SECTION( "Shared with another search" ) {
+    // Nodes held elsewhere aren't this agent's to release, so it only prunes
+    // its own share and keeps searching.
+    NodePool<MCTSNode> other;
+    other.set_budget(budget);
+    std::vector<std::shared_ptr<MCTSNode>> held;
+    for (auto i=0; i<50; ++i)
+      held.push_back(other.make(std::make_shared<const GameState>(*game)));
+
+    auto encoder = std::make_shared<SimpleEncoder>(5);
+    auto probe = std::make_shared<BudgetProbe>(std::make_shared<UniformEvaluator>(encoder->num_moves()),
+                                               budget);
+    auto agent = ZeroAgent(probe, encoder, 1000);
+    agent.set_node_budget(budget);
+    auto move = agent.select_move(*game);
+    REQUIRE( game->is_valid_move(move) );
+    REQUIRE( budget->size() == 50 );
+    REQUIRE( probe->max_nodes <= budget->limit() );
+    REQUIRE( agent.get_stats().num_pruned > 0 );
+  }
+
+  SECTION( "MCTS agent" ) {
+    auto agent = MCTSAgent(500, 1.5);
+    agent.set_node_budget(budget);
+    auto move = agent.select_move(*game);
+    REQUIRE( game->is_valid_move(move) );
+    REQUIRE( budget->size() == 0 );
+  }
+}
+
+TEST_CASE( "Node pool recycling", "[pool]" ) {
+  NodePool<MCTSNode> pool;
+  auto game = std::make_shared<const GameState>(*GameState::new_game(5));
+  auto root = pool.make(game);
+  auto child = root->add_random_child(pool);
+  REQUIRE( pool.num_free() == 0 );
+
+  // Releasing the root recycles its subtree, children first.
+  auto root_address = root.get();
+  root->record_win(Player::black);
+  child.reset();
+  root.reset();
+  REQUIRE( pool.num_free() == 2 );
+
+  auto reused = pool.make(game);
+  REQUIRE( pool.num_free() == 1 );
+  REQUIRE( reused.get() == root_address );
+  REQUIRE( reused->children.empty() );
+  REQUIRE( reused->num_rollouts == 0 );
+}
+
+TEST_CASE( "Node pool free list cap", "[pool]" ) {
+  NodePool<MCTSNode> pool;
+  REQUIRE( pool.max_free() == NodePool<MCTSNode>::DEFAULT_MAX_FREE );
+  pool.set_budget(std::make_shared<NodeBudget>(500));
+  REQUIRE( pool.max_free() == 500 );
+  pool.set_budget(nullptr);
+  pool.set_max_free(100);
+
+  // A large tree, with up to 20 children per node.
+  auto game = std::make_shared<const GameState>(*GameState::new_game(5));
+  std::vector<std::shared_ptr<MCTSNode>> nodes{pool.make(game)};
+  for (size_t i=0; nodes.size()<2000; ++i) {
+    auto parent = nodes[i / 20];
+    if (parent->can_add_child())
+      nodes.push_back(parent->add_random_child(pool));
+  }
+  REQUIRE( pool.size() == 2000 );
+
+  // Released nodes beyond the cap are deleted.
+  nodes.clear();
+  REQUIRE( pool.size() == 0 );
+  REQUIRE( pool.num_free() == 100 );
+  pool.set_max_free(10);
+  REQUIRE( pool.num_free() == 10 );
+}
+
+TEST_CASE( "Node pools sharing a budget", "[pool]" ) {
+  auto budget = std::make_shared<NodeBudget>(8);
+  NodePool<MCTSNode> first, second;
+  first.set_budget(budget);
+  second.set_budget(budget);
+  auto game = std::make_shared<const GameState>(*GameState::new_game(5));
+
+  std::vector<std::shared_ptr<MCTSNode>> nodes;
+  for (auto i=0; i<6; ++i)
+    nodes.push_back(first.make(game));
+  for (auto i=0; i<2; ++i)
+    nodes.push_back(second.make(game));
+  REQUIRE( first.size() == 6 );
+  REQUIRE( second.size() == 2 );
+  REQUIRE( budget->exhausted() );
+
+  // Each pool prunes in proportion to its share of the budget.
+  REQUIRE( first.prune_target(0.5) == 3 );
+  REQUIRE( second.prune_target(0.5) == 1 );
+
+  nodes.clear();
+  REQUIRE( first.size() == 0 );
+  REQUIRE( budget->size() == 0 );
+}
+
+TEST_CASE( "GTP time control", "[gtp]" ) {
+  using gtp::GameClock;
+  using gtp::TimeSettings;
+
+  SECTION( "No limit" ) {
+    REQUIRE( ! GameClock().budget(9, 0) );
+    // Overtime without stones means no time limit in GTP.
+    auto settings = TimeSettings::from_gtp(60, 10, 0);
+    REQUIRE( settings.system == TimeSettings::System::none );
+  }
+
+  SECTION( "Absolute" ) {
+    auto clock = GameClock(TimeSettings::from_gtp(300, 0, 0));
+    auto opening = clock.budget(9, 0).value();
+    auto middle = clock.budget(9, 20).value();
+    REQUIRE( opening.target < middle.target );
+    REQUIRE( middle.target <= middle.maximum );
+    REQUIRE( middle.maximum < 150 );
+    // Less time left means less time per move.
+    clock.record_move(200);
+    REQUIRE( clock.budget(9, 20).value().target < middle.target );
+    clock.set_time_left(0.1, 0);
+    REQUIRE( clock.budget(9, 20).value().target > 0 );
+  }
+
+  SECTION( "Canadian" ) {
+    auto clock = GameClock(TimeSettings::from_gtp(0, 100, 10));
+    auto budget = clock.budget(9, 20).value();
+    REQUIRE( budget.target < 10 );
+    REQUIRE( budget.maximum < 50 );
+    // The time is shared among the stones left in the period.
+    clock.set_time_left(20, 1);
+    REQUIRE( clock.budget(9, 20).value().maximum < 20 );
+    REQUIRE( clock.budget(9, 20).value().target > budget.target );
+  }
+
+  SECTION( "Byo-yomi" ) {
+    TimeSettings settings;
+    settings.system = TimeSettings::System::byo_yomi;
+    settings.main_time = 10;
+    settings.period_time = 5;
+    settings.period_stones = 3;
+    auto clock = GameClock(settings);
+    // The period resets every move, so it is available during main time too.
+    REQUIRE( clock.budget(9, 20).value().target > 2 );
+    clock.record_move(12);
+    auto budget = clock.budget(9, 20).value();
+    REQUIRE( budget.maximum < 5 );
+    REQUIRE( budget.target > 1 );
+  }
+}
+
+TEST_CASE( "GTP argument errors", "[gtp]" ) {
+  // Each command is answered, and later commands still work.
+  std::istringstream input("1 time_settings 300 10\n"
+                           "2 kgs-time_settings byoyomi 300 10\n"
+                           "3 kgs-time_settings absolute\n"
+                           "4 kgs-time_settings\n"
+                           "5 kgs-time_settings hourglass 300\n"
+                           "6 time_left b 30\n"
+                           "7 time_left b x 0\n"
+                           "8 komi abc\n"
+                           "9 boardsize 99999999999\n"
+                           "10 time_settings 300 10 1\n"
+                           "11 kgs-time_settings none\n"
+                           "12 time_left w 30 0\n");
+  std::ostringstream output;
+  gtp::GTPFrontend frontend(std::make_unique<RandomBot>(), false, input, output);
+  frontend.run();
+  REQUIRE( output.str() ==
+           "?1 syntax error\n\n"
+           "?2 syntax error\n\n"
+           "?3 syntax error\n\n"
+           "?4 syntax error\n\n"
+           "?5 unknown time system\n\n"
+           "?6 syntax error\n\n"
+           "?7 syntax error\n\n"
+           "?8 syntax error\n\n"
+           "?9 syntax error\n\n"
+           "=10 \n\n"
+           "=11 \n\n"
+           "=12 \n\n" );
+}
+
+TEST_CASE( "Search with a time budget", "[zero]" ) {
+  auto encoder = std::make_shared<SimpleEncoder>(5);
+  auto evaluator = std::make_shared<UniformEvaluator>(encoder->num_moves());
+  auto game = GameState::new_game(5);
+  game = game->apply_move(Move::play(Point(3, 3)));
+  auto budget = TimeBudget{0.05, 0.2};
+
+  SECTION( "Zero agent" ) {
+    auto agent = ZeroAgent(evaluator, encoder, 1);
+    agent.set_time_budget(budget);
+    auto timer = Timer();
+    REQUIRE( game->is_valid_move(agent.select_move(*game)) );
+    REQUIRE( timer.elapsed() < 1.0 );
+    // The round limit doesn't apply under time control.
+    REQUIRE( agent.get_stats().num_rounds > 1 );
+  }
+
+  SECTION( "MCTS agent" ) {
+    auto agent = MCTSAgent(1, 1.5);
+    agent.set_time_budget(budget);
+    auto timer = Timer();
+    REQUIRE( game->is_valid_move(agent.select_move(*game)) );
+    REQUIRE( timer.elapsed() < 1.0 );
+  }
+}
+
+TEST_CASE( "Tree reuse and pondering", "[zero]" ) {
+  auto encoder = std::make_shared<SimpleEncoder>(5);
+  auto evaluator = std::make_shared<UniformEvaluator>(encoder->num_moves());
+  auto budget = std::make_shared<NodeBudget>(500);
+  auto game = GameState::new_game(5);
+  game = game->apply_move(Move::play(Point(3, 3)));
+
+  auto agent = ZeroAgent(evaluator, encoder, 50);
+  agent.set_tree_reuse(true);
+  agent.set_node_budget(budget);
+
+  // Pondering stops once the tree holds half of the budget.
+  std::atomic<bool> stop = false;
+  agent.ponder(*game, stop);
+  REQUIRE( budget->size() == budget->limit() / 2 );
+
+  // The opponent's reply was searched while pondering, and its visits count
+  // towards the round limit.
+  game = game->apply_move(Move::play(Point(2, 2)));
+  REQUIRE( game->is_valid_move(agent.select_move(*game)) );
+  REQUIRE( agent.get_stats().num_rounds < 50 );
+
+  // The tree is kept until reuse is disabled.
+  REQUIRE( budget->size() > 0 );
+  agent.set_tree_reuse(false);
+  REQUIRE( budget->size() == 0 );
+
+  // Pondering only creates the root when stopped.
+  agent.set_tree_reuse(true);
+  stop = true;
+  agent.ponder(*game, stop);
+  REQUIRE( budget->size() == 1 );
+}
+
+TEST_CASE( "Streaming analysis", "[zero]" ) {
+  auto encoder = std::make_shared<SimpleEncoder>(5);
+  auto evaluator = std::make_shared<UniformEvaluator>(encoder->num_moves());
+  auto game = GameState::new_game(5);
+  game = game->apply_move(Move::play(Point(3, 3)));
+
+  auto agent = ZeroAgent(evaluator, encoder, 1);
+  REQUIRE( agent.supports_analysis() );
+  REQUIRE( ! MCTSAgent(1, 1.5).supports_analysis() );
+
+  // Search continues until stopped, regardless of the round limit.
+  std::atomic<bool> stop = false;
+  std::vector<std::vector<MoveAnalysis>> reports;
+  agent.analyze(*game, stop, 0.01, [&](const std::vector<MoveAnalysis>& moves) {
+    reports.push_back(moves);
+    if (reports.size() == 3)
+      stop = true;
+  });
+  REQUIRE( reports.size() == 3 );
+
+  const auto& moves = reports.back();
+  REQUIRE( moves.size() > 1 );
+  int total_visits = 0;
+  for (size_t i=0; i<moves.size(); ++i) {
+    REQUIRE( moves[i].visits > 0 );
+    REQUIRE( moves[i].pv.front() == moves[i].move );
+    REQUIRE( game->is_valid_move(moves[i].move) );
+    if (i > 0)
+      REQUIRE( moves[i].visits <= moves[i - 1].visits );
+    total_visits += moves[i].visits;
+  }
+  REQUIRE( total_visits > 1 );
+  REQUIRE( moves.front().pv.size() > 1 );
+}
+
+namespace {
+  /// Outputs derived from the first input of each position, so that results
+  /// can be matched to their requests.
+  class EchoEvaluator : public Evaluator {
+    int input_size;
+    int num_moves;
+
+  public:
+    EchoEvaluator(int input_size, int num_moves) : input_size(input_size), num_moves(num_moves) {}
+
+    void evaluate(const float* input, int batch_size, float* priors, float* values) {
+      for (auto i=0; i<batch_size; ++i) {
+        auto x = input[i * input_size];
+        std::fill_n(priors + i * num_moves, num_moves, 2 * x);
+        values[i] = x;
+      }
+    }
+  };
+}
+
+TEST_CASE( "Batching evaluator", "[batching]" ) {
+  const int input_size = 3;
+  const int num_moves = 2;
+  const int num_clients = 4;
+  const int num_requests = 50;
+  // With a long wait, batches are only run once every searching client is
+  // waiting.
+  BatchingEvaluator batching(std::make_shared<EchoEvaluator>(input_size, num_moves),
+                             input_size, num_moves, 16, 10.0);
+
+  std::vector<int> ids(num_clients);
+  std::vector<std::shared_ptr<Evaluator>> clients;
+  for (auto& id : ids) {
+    clients.push_back(batching.make_client(&id));
+    clients.back()->begin_search();
+  }
+  // An idle client doesn't hold up the others.
+  auto idle = batching.make_client();
+
+  std::vector<int> num_correct(num_clients);
+  std::vector<ClientStats> stats(num_clients);
+  std::vector<std::thread> threads;
+  for (auto c=0; c<num_clients; ++c) {
+    threads.emplace_back([&, c]() {
+      // Client c sends requests of c + 1 positions.
+      auto batch_size = c + 1;
+      std::vector<float> input(batch_size * input_size);
+      std::vector<float> priors(batch_size * num_moves);
+      std::vector<float> values(batch_size);
+      for (auto r=0; r<num_requests; ++r) {
+        for (auto i=0; i<batch_size; ++i)
+          input[i * input_size] = 1000 * c + 10 * r + i;
+        clients[c]->evaluate(input.data(), batch_size, priors.data(), values.data());
+        bool correct = true;
+        for (auto i=0; i<batch_size; ++i) {
+          auto x = input[i * input_size];
+          correct = correct && values[i] == x && priors[i * num_moves + 1] == 2 * x;
+        }
+        num_correct[c] += correct;
+      }
+      // Finishing lets the remaining clients run without waiting.
+      clients[c]->end_search();
+      stats[c] = batching.client_stats(ids[c]);
+      clients[c].reset();
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+
+  for (auto c=0; c<num_clients; ++c) {
+    REQUIRE( num_correct[c] == num_requests );
+    REQUIRE( stats[c].num_requests == num_requests );
+    REQUIRE( stats[c].num_positions == num_requests * (c + 1) );
+    REQUIRE( stats[c].max_latency < 5.0 );
+    // Clients are removed once destroyed.
+    REQUIRE_THROWS( batching.client_stats(ids[c]) );
+  }
+  // Every client has a request in each batch.
+  REQUIRE( batching.mean_batch_size() == 10.0 );
+}
+
+TEST_CASE( "SGF game records", "[sgf]" ) {
+  SECTION( "Main line" ) {
+    auto game = parse_sgf("(;GM[1]FF[4]SZ[9]KM[6.5]PB[Black \\] name]C[a (comment]\n"
+                          ";B[ee];W[cg](;B[]C[main];W[tt])(;B[aa]))");
+    REQUIRE( game.board_size == 9 );
+    REQUIRE( game.komi == 6.5 );
+    REQUIRE( ! game.has_setup );
+    REQUIRE( game.moves.size() == 4 );
+    REQUIRE( game.moves[0] == std::make_pair(Player::black, Move::play(Point(5, 5))) );
+    // Rows are counted from the top in SGF.
+    REQUIRE( game.moves[1] == std::make_pair(Player::white, Move::play(Point(3, 3))) );
+    REQUIRE( game.moves[2] == std::make_pair(Player::black, Move::pass()) );
+    REQUIRE( game.moves[3] == std::make_pair(Player::white, Move::pass()) );
+  }
+
+  SECTION( "Setup stones" ) {
+    auto game = parse_sgf("(;SZ[9]AB[cc][gg];W[ee])");
+    REQUIRE( game.has_setup );
+    REQUIRE( game.moves.size() == 1 );
+  }
+
+  SECTION( "Errors" ) {
+    REQUIRE_THROWS_AS( parse_sgf("no game"), std::runtime_error );
+    REQUIRE_THROWS_AS( parse_sgf("(;SZ[9];B[zz])"), std::runtime_error );
+    REQUIRE_THROWS_AS( parse_sgf("(;SZ[9];B[ee"), std::runtime_error );
+    REQUIRE_THROWS_AS( load_sgf("missing.sgf"), std::runtime_error );
+  }
+}
+
+TEST_CASE( "Position analysis", "[zero]" ) {
+  auto encoder = std::make_shared<SimpleEncoder>(5);
+  auto evaluator = std::make_shared<UniformEvaluator>(encoder->num_moves());
+  auto game = GameState::new_game(5);
+  game = game->apply_move(Move::play(Point(3, 3)));
+
+  auto agent = ZeroAgent(evaluator, encoder, 100);
+  auto analysis = agent.analyze_position(*game);
+  int total_visits = 0;
+  for (const auto& move : analysis)
+    total_visits += move.visits;
+  REQUIRE( total_visits == 100 );
+  REQUIRE( analysis.front().visits >= analysis.back().visits );
+  REQUIRE( game->is_valid_move(analysis.front().move) );
+}
+
+
+TEST_CASE( "Elo estimate", "[elo]" ) {
+  auto even = estimate_elo(50, 100);
+  REQUIRE( std::abs(even.elo) < 1e-9 );
+  REQUIRE( std::abs(even.lower + even.upper) < 1e-9 );
+  REQUIRE( even.upper > 60 );
+  REQUIRE( even.upper < 80 );
+
+  // 76% is about 200 Elo, and more games narrow the interval.
+  auto strong = estimate_elo(76, 100);
+  REQUIRE( std::abs(strong.elo - 200) < 1 );
+  REQUIRE( strong.lower < strong.elo );
+  REQUIRE( strong.upper > strong.elo );
+  auto more_games = estimate_elo(760, 1000);
+  REQUIRE( more_games.upper - more_games.lower < strong.upper - strong.lower );
+
+  auto sweep = estimate_elo(20, 20);
+  REQUIRE( std::isinf(sweep.elo) );
+  REQUIRE( std::isinf(sweep.upper) );
+  REQUIRE( sweep.lower > 0 );
+  REQUIRE( std::isfinite(sweep.lower) );
 }
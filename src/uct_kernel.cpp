@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+#include "uct_kernel.h"
+
+
+namespace {
+
+  constexpr float MIN_SCORE = -std::numeric_limits<float>::infinity();
+
+  inline float puct_score(float prior, int visit_count, float total_value,
+                          float c_sqrt_total) {
+    float n = static_cast<float>(visit_count);
+    // Unvisited branches have a total value of zero, so clamping the
+    // denominator gives q = 0 without a branch.
+    float q = total_value / std::max(n, 1.0f);
+    return q + c_sqrt_total * prior / (n + 1.0f);
+  }
+
+  inline float uct_score(int wins, int rollouts, float temperature, float log_total) {
+    float n = static_cast<float>(rollouts);
+    return static_cast<float>(wins) / n + temperature * std::sqrt(log_total / n);
+  }
+
+#if defined(__AVX512F__)
+
+  /// Running per-lane maximum and its index over 16-wide blocks.
+  struct VectorArgmax {
+    __m512 best = _mm512_set1_ps(MIN_SCORE);
+    __m512i best_index = _mm512_set1_epi32(-1);
+
+    void update(__m512 score, int offset, __mmask16 active = 0xFFFF) {
+      auto index = _mm512_add_epi32(_mm512_set1_epi32(offset),
+                                    _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7,
+                                                      8, 9, 10, 11, 12, 13, 14, 15));
+      auto mask = _mm512_mask_cmp_ps_mask(active, score, best, _CMP_GT_OQ);
+      best = _mm512_mask_blend_ps(mask, best, score);
+      best_index = _mm512_mask_blend_epi32(mask, best_index, index);
+    }
+
+    int reduce() const {
+      alignas(64) float scores[16];
+      alignas(64) int indices[16];
+      _mm512_store_ps(scores, best);
+      _mm512_store_si512(indices, best_index);
+      return reduce_lanes(scores, indices, 16);
+    }
+
+    static int reduce_lanes(const float* scores, const int* indices, int lanes) {
+      float score = MIN_SCORE;
+      int index = -1;
+      for (int i=0; i<lanes; ++i) {
+        if (indices[i] < 0)
+          continue;
+        if (index < 0 || scores[i] > score || (scores[i] == score && indices[i] < index)) {
+          score = scores[i];
+          index = indices[i];
+        }
+      }
+      // As in the scalar code, the first branch is selected if no score beats
+      // the minimum (e.g., all scores are NaN).
+      return std::max(index, 0);
+    }
+  };
+
+#elif defined(__AVX2__)
+
+  /// Running per-lane maximum and its index over 8-wide blocks.
+  struct VectorArgmax {
+    __m256 best = _mm256_set1_ps(MIN_SCORE);
+    __m256i best_index = _mm256_set1_epi32(-1);
+
+    void update(__m256 score, int offset) {
+      auto index = _mm256_add_epi32(_mm256_set1_epi32(offset),
+                                    _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+      auto mask = _mm256_cmp_ps(score, best, _CMP_GT_OQ);
+      best = _mm256_blendv_ps(best, score, mask);
+      best_index = _mm256_castps_si256(
+        _mm256_blendv_ps(_mm256_castsi256_ps(best_index), _mm256_castsi256_ps(index), mask));
+    }
+
+    /// Returns the index of the best lane, and its score through `score`.
+    int reduce(float& score) const {
+      alignas(32) float scores[8];
+      alignas(32) int indices[8];
+      _mm256_store_ps(scores, best);
+      _mm256_store_si256(reinterpret_cast<__m256i*>(indices), best_index);
+      score = MIN_SCORE;
+      int index = -1;
+      for (int i=0; i<8; ++i) {
+        if (indices[i] < 0)
+          continue;
+        if (index < 0 || scores[i] > score || (scores[i] == score && indices[i] < index)) {
+          score = scores[i];
+          index = indices[i];
+        }
+      }
+      // As in the scalar code, the first branch is selected if no score beats
+      // the minimum (e.g., all scores are NaN).
+      if (index < 0) {
+        score = MIN_SCORE;
+        index = 0;
+      }
+      return index;
+    }
+  };
+
+#endif
+
+}
+
+
+int select_puct_scalar(const float* priors, const int* visit_counts,
+                       const float* total_values, int num_branches,
+                       float c_sqrt_total) {
+  assert(num_branches > 0);
+  float best = MIN_SCORE;
+  int best_index = 0;
+  for (int i=0; i<num_branches; ++i) {
+    auto score = puct_score(priors[i], visit_counts[i], total_values[i], c_sqrt_total);
+    if (score > best) {
+      best = score;
+      best_index = i;
+    }
+  }
+  return best_index;
+}
+
+
+int select_uct_scalar(const int* wins, const int* rollouts, int num_children,
+                      float temperature, float log_total) {
+  assert(num_children > 0);
+  float best = MIN_SCORE;
+  int best_index = 0;
+  for (int i=0; i<num_children; ++i) {
+    assert(rollouts[i] > 0);
+    auto score = uct_score(wins[i], rollouts[i], temperature, log_total);
+    if (score > best) {
+      best = score;
+      best_index = i;
+    }
+  }
+  return best_index;
+}
+
+
+#if defined(__AVX512F__)
+
+int select_puct(const float* priors, const int* visit_counts,
+                const float* total_values, int num_branches,
+                float c_sqrt_total) {
+  assert(num_branches > 0);
+  const auto c = _mm512_set1_ps(c_sqrt_total);
+  const auto one = _mm512_set1_ps(1.0f);
+  VectorArgmax argmax;
+  for (int i=0; i<num_branches; i+=16) {
+    __mmask16 active = (num_branches - i >= 16) ? 0xFFFF : ((1u << (num_branches - i)) - 1);
+    auto p = _mm512_maskz_loadu_ps(active, priors + i);
+    auto n = _mm512_cvtepi32_ps(_mm512_maskz_loadu_epi32(active, visit_counts + i));
+    auto w = _mm512_maskz_loadu_ps(active, total_values + i);
+    auto q = _mm512_div_ps(w, _mm512_max_ps(n, one));
+    auto u = _mm512_div_ps(_mm512_mul_ps(c, p), _mm512_add_ps(n, one));
+    argmax.update(_mm512_add_ps(q, u), i, active);
+  }
+  return argmax.reduce();
+}
+
+int select_uct(const int* wins, const int* rollouts, int num_children,
+               float temperature, float log_total) {
+  assert(num_children > 0);
+  const auto t = _mm512_set1_ps(temperature);
+  const auto log_n = _mm512_set1_ps(log_total);
+  VectorArgmax argmax;
+  for (int i=0; i<num_children; i+=16) {
+    __mmask16 active = (num_children - i >= 16) ? 0xFFFF : ((1u << (num_children - i)) - 1);
+    auto w = _mm512_cvtepi32_ps(_mm512_maskz_loadu_epi32(active, wins + i));
+    // Inactive lanes load a count of one to avoid dividing by zero.
+    auto n = _mm512_cvtepi32_ps(_mm512_mask_loadu_epi32(_mm512_set1_epi32(1), active, rollouts + i));
+    auto q = _mm512_div_ps(w, n);
+    auto e = _mm512_sqrt_ps(_mm512_div_ps(log_n, n));
+    argmax.update(_mm512_add_ps(q, _mm512_mul_ps(t, e)), i, active);
+  }
+  return argmax.reduce();
+}
+
+#elif defined(__AVX2__)
+
+int select_puct(const float* priors, const int* visit_counts,
+                const float* total_values, int num_branches,
+                float c_sqrt_total) {
+  assert(num_branches > 0);
+  const auto c = _mm256_set1_ps(c_sqrt_total);
+  const auto one = _mm256_set1_ps(1.0f);
+  VectorArgmax argmax;
+  int i = 0;
+  for (; i + 8 <= num_branches; i+=8) {
+    auto p = _mm256_loadu_ps(priors + i);
+    auto n = _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(visit_counts + i)));
+    auto w = _mm256_loadu_ps(total_values + i);
+    auto q = _mm256_div_ps(w, _mm256_max_ps(n, one));
+    auto u = _mm256_div_ps(_mm256_mul_ps(c, p), _mm256_add_ps(n, one));
+    argmax.update(_mm256_add_ps(q, u), i);
+  }
+  float best;
+  int best_index = argmax.reduce(best);
+  // Remaining branches.  These all have higher indices, so a strict comparison
+  // preserves the lowest-index tie break.
+  for (; i<num_branches; ++i) {
+    auto score = puct_score(priors[i], visit_counts[i], total_values[i], c_sqrt_total);
+    if (score > best) {
+      best = score;
+      best_index = i;
+    }
+  }
+  return best_index;
+}
+
+int select_uct(const int* wins, const int* rollouts, int num_children,
+               float temperature, float log_total) {
+  assert(num_children > 0);
+  const auto t = _mm256_set1_ps(temperature);
+  const auto log_n = _mm256_set1_ps(log_total);
+  VectorArgmax argmax;
+  int i = 0;
+  for (; i + 8 <= num_children; i+=8) {
+    auto w = _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(wins + i)));
+    auto n = _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(rollouts + i)));
+    auto q = _mm256_div_ps(w, n);
+    auto e = _mm256_sqrt_ps(_mm256_div_ps(log_n, n));
+    argmax.update(_mm256_add_ps(q, _mm256_mul_ps(t, e)), i);
+  }
+  float best;
+  int best_index = argmax.reduce(best);
+  for (; i<num_children; ++i) {
+    auto score = uct_score(wins[i], rollouts[i], temperature, log_total);
+    if (score > best) {
+      best = score;
+      best_index = i;
+    }
+  }
+  return best_index;
+}
+
+#else
+
+int select_puct(const float* priors, const int* visit_counts,
+                const float* total_values, int num_branches,
+                float c_sqrt_total) {
+  return select_puct_scalar(priors, visit_counts, total_values, num_branches, c_sqrt_total);
+}
+
+int select_uct(const int* wins, const int* rollouts, int num_children,
+               float temperature, float log_total) {
+  return select_uct_scalar(wins, rollouts, num_children, temperature, log_total);
+}
+
+#endif
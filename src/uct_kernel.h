@@ -0,0 +1,33 @@
+#ifndef UCT_KERNEL_H
+#define UCT_KERNEL_H
+
+/// Vectorized child selection for the tree search agents.
+///
+/// Both kernels operate on edge statistics stored contiguously in the parent
+/// node and return the index of the highest scoring child.  Ties resolve to the
+/// lowest index, matching std::max_element.  AVX-512 or AVX2 code is used when
+/// the compiler targets those instruction sets, with a scalar fallback
+/// otherwise.
+
+/// PUCT score used by the zero agent:
+///   q + c * p * sqrt(N) / (n + 1)
+/// where q = total_value / n, or 0 for unvisited branches.  The caller passes
+/// c * sqrt(N) as `c_sqrt_total` so that it is only computed once per node.
+int select_puct(const float* priors, const int* visit_counts,
+                const float* total_values, int num_branches,
+                float c_sqrt_total);
+
+/// UCT score used by the pure MCTS agent:
+///   wins / n + temperature * sqrt(log(N) / n)
+/// All children must have at least one rollout.
+int select_uct(const int* wins, const int* rollouts, int num_children,
+               float temperature, float log_total);
+
+/// Scalar reference implementations, public for testing.
+int select_puct_scalar(const float* priors, const int* visit_counts,
+                       const float* total_values, int num_branches,
+                       float c_sqrt_total);
+int select_uct_scalar(const int* wins, const int* rollouts, int num_children,
+                      float temperature, float log_total);
+
+#endif // UCT_KERNEL_H
@@ -1,4 +1,5 @@
 
+#include <cmath>
 #include <iostream>
 #include <iomanip>
 #include <sstream>
@@ -58,3 +59,16 @@ std::string format_seconds(double seconds) {
     ss << seconds / day << " d";
   return ss.str();
 }
+
+
+EloEstimate estimate_elo(double score, int num_games) {
+  auto elo = [](double p) {
+    return 400.0 * std::log10(p / (1.0 - p));
+  };
+  constexpr double z = 1.96;
+  const double n = num_games;
+  const double p = score / n;
+  const double center = (p + z * z / (2 * n)) / (1 + z * z / n);
+  const double half_width = z * std::sqrt(p * (1 - p) / n + z * z / (4 * n * n)) / (1 + z * z / n);
+  return {elo(p), elo(std::max(0.0, center - half_width)), elo(std::min(1.0, center + half_width))};
+}
@@ -39,5 +39,17 @@ private:
 
 std::string format_seconds(double);
 
+/// Elo difference implied by a match score, with a 95% confidence interval.
+/// The estimate and one bound are infinite if every game was won or lost.
+struct EloEstimate {
+  double elo;
+  double lower;
+  double upper;
+};
+
+/// score is wins plus half of any draws.  Uses the Wilson score interval,
+/// which stays inside (0, 1) for lopsided results.
+EloEstimate estimate_elo(double score, int num_games);
+
 
 #endif // UTILS_H
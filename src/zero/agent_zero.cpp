@@ -1,223 +1,731 @@
 #include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <numeric>
+#include <thread>
+#include <unordered_set>
 
 #include "agent_zero.h"
 #include "../myrand.h"
+#include "../utils.h"
+#include "../uct_kernel.h"
 #include "dihedral.h"
 
 
 ZeroNode::ZeroNode(ConstGameStatePtr game_state, float value,
-                   std::unordered_map<Move, float, MoveHash> priors,
-                   std::weak_ptr<ZeroNode> parent,
-                   std::optional<Move> last_move,
-                   bool add_noise) :
-  game_state(game_state), value(value), parent(parent), last_move(last_move),
-  terminal(game_state->is_over()) {
+                   const float* move_priors,
+                   const Encoder& encoder,
+                   bool add_noise,
+                   bool expand_all) {
+  init(game_state, value, move_priors, encoder, add_noise, expand_all);
+}
 
-  for (const auto &[move, p] : priors) {
-    if (game_state->is_valid_move(move))
-      branches.emplace(move, p);
-  }
 
-  assert((! branches.empty()) || terminal);
+void ZeroNode::init(ConstGameStatePtr game_state, float value,
+                    const float* move_priors,
+                    const Encoder& encoder,
+                    bool add_noise,
+                    bool expand_all) {
+  this->game_state = game_state;
+  this->value = value;
+  terminal = game_state->is_over();
+  proof = Proof::none;
+  total_visit_count = 1;
+  total_value = 0.0;
+  last_round = -1;
+  // Clearing keeps the capacity of a recycled node's vectors.
+  moves.clear();
+  priors.clear();
+  visit_counts.clear();
+  total_values.clear();
+  children.clear();
+  lost_priors.clear();
+  candidates.clear();
+
+  if (! terminal) {
+    const auto& board = *game_state->board;
+    for (auto i=0; i<encoder.num_moves(); ++i) {
+      auto move = encoder.decode_move_index(i);
+      if (move.is_pass || ! board.get(move.point.value()))
+        candidates.emplace_back(move_priors[i], i);
+    }
+    std::make_heap(candidates.begin(), candidates.end());
+
+    if (expand_all)
+      while (widen(encoder));
+    else
+      widen(encoder);
+  }
 
-  if (add_noise && ! branches.empty()) {
-    // std::cout << "Orig prior: ";
-    // for (const auto &[move, p] : priors)
-    //   std::cout << move << " " << p << ", ";
-    // std::cout << std::endl;
+  assert((! moves.empty()) || terminal);
+  assert(expand_all || ! add_noise);
 
+  if (add_noise && ! moves.empty()) {
     // Sample noise on legal moves:
     // Adjust concentration based on number of legal moves, following Katago
     // paper.
-    double alpha = DIRICHLET_CONCENTRATION * 19.0 * 19.0 / branches.size();
-    auto dirichlet_dist = DirichletDistribution(branches.size(), alpha);
+    double alpha = DIRICHLET_CONCENTRATION * 19.0 * 19.0 / moves.size();
+    auto dirichlet_dist = DirichletDistribution(moves.size(), alpha);
     std::vector<double> noise = dirichlet_dist.sample();
     // std::cout << "Noise: " << noise << std::endl;
 
-    size_t idx = 0;
-    for (auto &[move, prior]: priors) {
-      prior = (1.0 - DIRICHLET_WEIGHT) * prior +
-        DIRICHLET_WEIGHT * noise[idx];
-      ++idx;
+    for (size_t i=0; i<priors.size(); ++i) {
+      priors[i] = (1.0 - DIRICHLET_WEIGHT) * priors[i] +
+        DIRICHLET_WEIGHT * noise[i];
     }
-
-    // std::cout << "Noised prior: ";
-    // for (const auto &[move, p] : priors)
-    //   std::cout << move << " " << p << ", ";
-    // std::cout << std::endl;
   }
 
   if (terminal) {
     // Override the model's value estimate with actual result
-    ZeroNode::value = (game_state->next_player == game_state->winner().value()) ? 1.0 : -1.0;
+    this->value = (game_state->next_player == game_state->winner().value()) ? 1.0 : -1.0;
+    proof = this->value > 0 ? Proof::win : Proof::loss;
+  }
+}
+
+
+bool ZeroNode::widen(const Encoder& encoder) {
+  while (! candidates.empty()) {
+    std::pop_heap(candidates.begin(), candidates.end());
+    auto [prior, index] = candidates.back();
+    candidates.pop_back();
+    auto move = encoder.decode_move_index(index);
+    if (game_state->is_valid_move(move)) {
+      moves.push_back(move);
+      priors.push_back(prior);
+      visit_counts.push_back(0);
+      total_values.push_back(0.0);
+      children.emplace_back();
+      return true;
+    }
+  }
+  candidates.shrink_to_fit();
+  return false;
+}
+
+
+PositionKey::PositionKey(const GameState& game_state, std::vector<Point> ko_points) :
+  hash(game_state.board->get_hash()),
+  next_player(game_state.next_player),
+  last_move_pass(game_state.is_last_move_pass()),
+  ko_points(std::move(ko_points)) {}
+
+
+bool ZeroNode::update_proof(int branch) {
+  if (proof != Proof::none)
+    return false;
+  const auto& child = children[branch];
+  if (! child || child->proof == Proof::none)
+    return false;
+  if (child->proof == Proof::loss) {
+    proof = Proof::win;
+    return true;
+  }
+  // The branch loses, so stop spending exploration on it.
+  if (priors[branch] > 0) {
+    lost_priors.emplace_back(branch, priors[branch]);
+    priors[branch] = 0.0;
   }
+  if (! candidates.empty())
+    return false;
+  for (const auto& c : children) {
+    if (! c || c->proof != Proof::win)
+      return false;
+  }
+  proof = Proof::loss;
+  return true;
 }
 
 
-void ZeroNode::record_visit(Move move, float value) {
-  ++total_visit_count;
-  auto it = branches.find(move);
-  assert(it != branches.end());
-  (it->second.visit_count)++;
-  (it->second.total_value) += value;
+float ZeroNode::prior(int branch) const {
+  for (const auto& [b, prior] : lost_priors) {
+    if (b == branch)
+      return prior;
+  }
+  return priors[branch];
 }
 
 
-float ZeroNode::expected_value(Move m) const {
-  auto branch = branches.find(m)->second;
-  if (branch.visit_count == 0)
-    return 0.0;
-  return branch.total_value / branch.visit_count;
+int ZeroNode::branch_index(Move m) const {
+  auto it = std::find(moves.begin(), moves.end(), m);
+  if (it == moves.end())
+    return -1;
+  return it - moves.begin();
 }
 
 
 Move ZeroAgent::select_move(const GameState& game_state) {
   // std::cerr << "In select move, prior move count: " << game_state.num_moves << std::endl;
-  auto root = create_node(std::make_shared<const GameState>(game_state));
-
-  for (auto round_number=0; round_number < num_rounds; ++round_number) {
-    // std::cout << "Round: " << round_number << std::endl;
-    auto node = root;
-    auto next_move = select_branch(*node);
-    // std::cout << "Selected root move: " << next_move << std::endl;
-    // for (auto it = node->children.find(next_move); it != node->children.end();) {
-    for (std::unordered_map<Move, std::shared_ptr<ZeroNode>, MoveHash>::const_iterator it;
-         it = node->children.find(next_move), it != node->children.end();) {
-      node = it->second;
-      if (node->terminal)
-        break;
-      next_move = select_branch(*node);
-    }
+  SearchScope scope(*evaluator);
+  bool full_search = true;
+  if (fast_rounds > 0) {
+    std::bernoulli_distribution dist(full_search_probability);
+    full_search = dist(rng);
+  }
+  int max_rounds = full_search ? num_rounds : fast_rounds;
+
+  // Gumbel search does its own exploration at the root, in place of noise.
+  auto root_state = std::make_shared<const GameState>(game_state);
+  auto root = reuse_tree(game_state);
+  if (root)
+    max_rounds = std::max(max_rounds - (root->total_visit_count - 1), 0);
+  else
+    root = create_node(root_state, true, root_noise && full_search && ! gumbel);
+  transpositions.clear();
+  if (graph_search)
+    transpositions.emplace(PositionKey(*root_state), root);
 
-    float value;
-    std::optional<Move> move;
-    if (! node->terminal) {
-      auto new_state = node->game_state->apply_move(next_move);
-      auto child_node = create_node(new_state, next_move, node);
-      value = -1 * child_node->value;
-      move = next_move;
-    }
-    else {
-      value = node->value;
+  int greedy_move_threshold = REFERENCE_GREEDY_MOVE_THRESHOLD * game_state.board->num_rows / 19;
+  bool select_greedy = greedy || game_state.num_moves > greedy_move_threshold;
+  // Recorded visit counts are policy targets, so they come from complete
+  // searches.
+  bool stop_early = early_stopping && select_greedy && ! (collector && full_search);
+
+  int round_number = 0;
+  auto timer = Timer();
+  // Selected branch and improved policy for Gumbel search.
+  int gumbel_branch = -1;
+  std::vector<float> gumbel_policy;
+  if (gumbel) {
+    if (time_budget && rounds_per_second > 0)
+      max_rounds = std::max(static_cast<int>(rounds_per_second * time_budget->target), 1);
+    // Gumbel noise is only used for self-play exploration, where it replaces
+    // temperature and noise in the opening.
+    gumbel_branch = gumbel_search(*root, max_rounds, full_search && ! greedy,
+                                  gumbel_policy, round_number);
+  }
+  else if (time_budget) {
+    while (true) {
+      search_round(*root);
+      ++round_number;
+      if (root->proof != Proof::none)
+        break;
+      auto elapsed = timer.elapsed();
+      if (elapsed >= time_budget->maximum)
+        break;
+      if (elapsed >= time_budget->target && is_search_settled(*root))
+        break;
+      // Rounds that fit in the remaining time, at the rate so far.
+      if (stop_early && elapsed > 0 &&
+          is_search_decided(*root, static_cast<int>((time_budget->maximum - elapsed) * round_number / elapsed)))
+        break;
     }
-
-    while (node) {
-      if (node->terminal)
-        (node->total_visit_count)++;
-      else
-        node->record_visit(move.value(), value);
-      move = node->last_move; // Will be null at root node
-      node = node->parent.lock();
-      value = -1 * value;
+  }
+  else {
+    while (round_number < max_rounds) {
+      // std::cout << "Round: " << round_number << std::endl;
+      search_round(*root);
+      ++round_number;
+      if (root->proof != Proof::none)
+        break;
+      if (stop_early && is_search_decided(*root, max_rounds - round_number))
+        break;
     }
   }
-
-  if (collector) {
+  if (time_budget) {
+    auto elapsed = timer.elapsed();
+    if (elapsed > 0)
+      rounds_per_second = round_number / elapsed;
+  }
+  if (tree_reuse && ! gumbel)
+    search_root = root;
+  ++stats.num_moves;
+  stats.num_rounds += round_number;
+  if (! time_budget || gumbel)
+    stats.rounds_saved += max_rounds - round_number;
+  if (full_search)
+    ++stats.num_full_searches;
+
+  if (collector && full_search) {
     auto root_state_tensor = encoder->encode(game_state);
     auto visit_counts = torch::zeros(encoder->num_moves());
-    auto get_visit_count = [&](int i) {
-      auto move = encoder->decode_move_index(i);
-      auto it = root->branches.find(move);
-      if (it != root->branches.end())
-        return it->second.visit_count;
-      else
-        return 0;
-    };
-    for (auto i=0; i < encoder->num_moves(); ++i) {
-      visit_counts.index_put_({i}, static_cast<float>(get_visit_count(i)));
+    auto visit_counts_data = visit_counts.data_ptr<float>();
+    for (auto i=0; i < root->num_branches(); ++i) {
+      visit_counts_data[encoder->encode_move(root->moves[i])] =
+        gumbel ? gumbel_policy[i] : root->visit_counts[i];
     }
     collector->record_decision(root_state_tensor, visit_counts);
   }
+  else if (collector && record_fast_searches) {
+    collector->record_position(encoder->encode(game_state), encoder->num_moves());
+  }
 
-  int greedy_move_threshold = REFERENCE_GREEDY_MOVE_THRESHOLD * game_state.board->num_rows / 19;
-  if (greedy || game_state.num_moves > greedy_move_threshold) {
-      // Select the move with the highest visit count
-      auto max_it = std::max_element(root->branches.begin(), root->branches.end(),
-                                     [&root] (const auto& p1, const auto& p2) {
-                                       return root->visit_count(p1.first) < root->visit_count(p2.first);
-                                     });
+  auto best_branch = ZeroAgent::best_branch(*root);
+  if (gumbel && root->proof == Proof::none)
+    best_branch = gumbel_branch;
+
+  auto root_value = root->expected_value(best_branch);
+  min_root_value = std::min(min_root_value, root_value);
+  if (resign_threshold && root_value < resign_threshold.value())
+    return Move::resign();
 
-      // for (const auto& [m, b] : root->branches)
-      //   std::cerr << "visits: " << m << " " << b.visit_count << std::endl;
-      // std::cerr << "E[V] = " << max_it->second.total_value / max_it->second.visit_count << ", visits = " << max_it->second.visit_count << std::endl;
-      return max_it->first;
+  if (select_greedy || gumbel || root->proof != Proof::none) {
+      // Select the move with the highest visit count
+      // for (auto i=0; i < root->num_branches(); ++i)
+      //   std::cerr << "visits: " << root->moves[i] << " " << root->visit_counts[i] << std::endl;
+      return root->moves[best_branch];
   }
   else {
     // Select move randomly in proportion to visit counts
-    std::vector<Move> moves;
-    std::vector<int> visit_counts;
-    for (const auto& [move, branch] : root->branches) {
-      moves.push_back(move);
-      visit_counts.push_back(root->visit_count(move));
+    std::discrete_distribution<> dist(root->visit_counts.begin(), root->visit_counts.end());
+    return root->moves[dist(rng)];
+  }
+}
+
+
+
+void ZeroAgent::ponder(const GameState& game_state, const std::atomic<bool>& stop) {
+  if (! tree_reuse || gumbel || game_state.is_over())
+    return;
+  SearchScope scope(*evaluator);
+  auto root = reuse_tree(game_state);
+  if (! root)
+    root = create_node(std::make_shared<const GameState>(game_state), true);
+  search_root = root;
+  transpositions.clear();
+  if (graph_search)
+    transpositions.emplace(PositionKey(game_state), root);
+  // Pondering doesn't prune, so that it can't discard the search done so far.
+  const auto& budget = node_pool.budget();
+  const long max_nodes = budget ? PONDER_BUDGET_FRACTION * budget->limit() : 0;
+  while (! stop && root->proof == Proof::none && ! node_pool.exhausted() &&
+         (! budget || node_pool.size() < max_nodes))
+    search_round(*root);
+}
+
+
+void ZeroAgent::analyze(const GameState& game_state, const std::atomic<bool>& stop,
+                        double interval, const AnalysisCallback& report) {
+  SearchScope scope(*evaluator);
+  auto root = reuse_tree(game_state);
+  if (! root)
+    root = create_node(std::make_shared<const GameState>(game_state), true);
+  if (tree_reuse && ! gumbel)
+    search_root = root;
+  transpositions.clear();
+  if (graph_search)
+    transpositions.emplace(PositionKey(game_state), root);
+
+  auto timer = Timer();
+  while (! stop) {
+    if (root->proof == Proof::none)
+      search_round(*root);
+    else
+      // Nothing is left to search, but the client still expects reports.
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    if (timer.elapsed() >= interval) {
+      report(root_analysis(*root));
+      timer.reset();
     }
-    std::discrete_distribution<> dist(visit_counts.begin(), visit_counts.end());
-    return moves[dist(rng)];
   }
 }
 
 
+std::vector<MoveAnalysis> ZeroAgent::analyze_position(const GameState& game_state) {
+  SearchScope scope(*evaluator);
+  auto root = reuse_tree(game_state);
+  int max_rounds = num_rounds;
+  if (root)
+    max_rounds = std::max(max_rounds - (root->total_visit_count - 1), 0);
+  else
+    root = create_node(std::make_shared<const GameState>(game_state), true);
+  if (tree_reuse && ! gumbel)
+    search_root = root;
+  transpositions.clear();
+  if (graph_search)
+    transpositions.emplace(PositionKey(game_state), root);
+
+  int round_number = 0;
+  if (gumbel) {
+    std::vector<float> policy;
+    gumbel_search(*root, max_rounds, false, policy, round_number);
+  }
+  else {
+    while (round_number < max_rounds && root->proof == Proof::none) {
+      search_round(*root);
+      ++round_number;
+    }
+  }
+  stats.num_rounds += round_number;
+  return root_analysis(*root);
+}
 
-std::shared_ptr<ZeroNode> ZeroAgent::create_node(ConstGameStatePtr game_state,
-                                                 std::optional<Move> move,
-                                                 std::weak_ptr<ZeroNode> parent) {
 
-  // Note: also want to place this prior to loading jit model as well
-  c10::InferenceMode guard;
+std::vector<MoveAnalysis> ZeroAgent::root_analysis(const ZeroNode& root) {
+  std::vector<MoveAnalysis> analysis;
+  for (auto i=0; i<root.num_branches(); ++i) {
+    if (root.visit_counts[i] == 0)
+      continue;
+    MoveAnalysis move{root.moves[i], root.visit_counts[i], root.expected_value(i), root.prior(i),
+                      {root.moves[i]}};
+    // Follow the most visited branches.  The length limit also guards
+    // against cycles in graph search.
+    const ZeroNode* node = root.children[i].get();
+    while (node && node->num_branches() > 0 && move.pv.size() < MAX_PV_LENGTH) {
+      auto it = std::max_element(node->visit_counts.begin(), node->visit_counts.end());
+      if (*it == 0)
+        break;
+      auto branch = it - node->visit_counts.begin();
+      move.pv.push_back(node->moves[branch]);
+      node = node->children[branch].get();
+    }
+    analysis.push_back(std::move(move));
+  }
+  std::stable_sort(analysis.begin(), analysis.end(),
+                   [](const auto& a, const auto& b) { return a.visits > b.visits; });
+  return analysis;
+}
+
 
-  auto transform = Dihedral();
-  auto state_tensor = encoder->encode(*game_state);
-  // Random rotation or reflection:
-  state_tensor = transform.forward(state_tensor);
-  state_tensor.unsqueeze_(0);
+std::shared_ptr<ZeroNode> ZeroAgent::reuse_tree(const GameState& game_state) {
+  if (! tree_reuse || gumbel || ! search_root)
+    return nullptr;
+  int depth = game_state.num_moves - search_root->game_state->num_moves;
+  std::vector<std::shared_ptr<ZeroNode>> level;
+  if (depth >= 0 && depth <= MAX_REUSE_DEPTH)
+    level.push_back(search_root);
+  for (int d=0; d<depth && ! level.empty(); ++d) {
+    std::vector<std::shared_ptr<ZeroNode>> next_level;
+    for (const auto& node : level) {
+      for (const auto& child : node->children) {
+        if (child)
+          next_level.push_back(child);
+      }
+    }
+    level.swap(next_level);
+  }
 
-  std::vector<torch::jit::IValue> input({state_tensor});
-  auto output = model.forward(input);
-  auto priors = output.toTuple()->elements()[0].toTensor(); // Shape: (1, num_moves)
-  auto values = output.toTuple()->elements()[1].toTensor();
+  std::shared_ptr<ZeroNode> root;
+  PositionKey key(game_state);
+  for (const auto& node : level) {
+    if (PositionKey(*node->game_state) == key) {
+      root = node;
+      break;
+    }
+  }
+  // Release the rest of the previous tree.
+  level.clear();
+  search_root.reset();
+  if (root) {
+    // Nodes below the root were expanded lazily.
+    while (root->widen(*encoder));
+  }
+  return root;
+}
 
-  // std::cout << "priors before transform: " << priors << std::endl;
-  // std::cout << "priors before transform: " << priors.index({0, torch::indexing::Slice(0, 6)}) << std::endl;
-  // Apply reverse transformation to the priors tensor.
-  priors = encoder->untransform_policy(priors, transform);
-  // std::cout << "priors after transform: " << priors << std::endl;
 
-  values.squeeze_();
-  priors.squeeze_();
-  // std::cout << "priors size: " << at::numel(priors) << std::endl;
-  auto value = values.item().toFloat();
+void ZeroAgent::search_round(ZeroNode& root, int forced_branch) {
+  if (node_pool.exhausted())
+    prune_tree(root);
+
+  path.clear();
+  ++round_id;
+  auto node = &root;
+  // Value of the leaf position, from the perspective of its player to move.
+  float value;
+  while (true) {
+    node->last_round = round_id;
+    // Terminal and proven nodes don't need further search.
+    if (node->proof != Proof::none) {
+      (node->total_visit_count)++;
+      value = node->mean_value();
+      break;
+    }
+    auto branch = (forced_branch >= 0 && node == &root) ? forced_branch : select_branch(*node);
+    // Unvisited branches are scored by prior alone, so the unvisited branch
+    // with the highest prior dominates the rest.  Add the next branch once the
+    // newest one is selected for the first time.
+    if (branch == node->num_branches() - 1 && node->visit_counts[branch] == 0)
+      node->widen(*encoder);
+    path.emplace_back(node, branch);
+    auto& child = node->children[branch];
+    if (! child) {
+      auto new_state = node->game_state->apply_move(node->moves[branch]);
+      if (! graph_search) {
+        child = create_node(new_state);
+        value = child->value;
+        break;
+      }
+      // Finding ko points copies the board, so do it once for both the key
+      // and the encoding.
+      PositionKey key(*new_state, new_state->ko_points());
+      auto it = transpositions.find(key);
+      if (it != transpositions.end() && (child = it->second.lock())) {
+        ++stats.num_transpositions;
+      }
+      else {
+        child = create_node(new_state, key.ko_points);
+        transpositions[key] = child;
+        value = child->value;
+        break;
+      }
+    }
+    if (graph_search) {
+      // Edge value from this node's perspective, and the shared child's value
+      // converted to the same perspective.
+      auto edge_visits = node->visit_counts[branch];
+      auto target = -1 * child->mean_value();
+      bool on_path = child->last_round == round_id;
+      if (on_path || (edge_visits < child->total_visit_count &&
+                      std::abs(node->expected_value(branch) - target) > GRAPH_VALUE_TOLERANCE)) {
+        // Back up the value that moves the edge's mean to the child's value.
+        // This also handles a new edge to an existing node without evaluating
+        // it again, and cuts cycles.
+        auto correction = edge_visits * (target - node->expected_value(branch)) + target;
+        value = -1 * std::clamp(correction, -1.0f, 1.0f);
+        break;
+      }
+    }
+    node = child.get();
+  }
 
-  std::unordered_map<Move, float, MoveHash> move_priors;
-  for (auto i=0; i<at::numel(priors); ++i) {
-    move_priors.emplace(encoder->decode_move_index(i), priors.index({i}).item().toFloat());
+  // Proofs only need to be checked while the nodes below keep changing.
+  bool proven = true;
+  for (auto it = path.rbegin(); it != path.rend(); ++it) {
+    value = -1 * value;
+    it->first->record_visit(it->second, value);
+    if (proven)
+      proven = it->first->update_proof(it->second);
   }
+}
+
 
-  auto new_node = std::make_shared<ZeroNode>(game_state, value,
-                                             std::move(move_priors),
-                                             parent,
-                                             move,
-                                             ! parent.lock());
-  auto parent_shared = parent.lock();
-  if (parent_shared) {
-    assert(move);
-    parent_shared->add_child(move.value(), new_node);
+int ZeroAgent::best_branch(const ZeroNode& root) {
+  int best = -1;
+  for (auto i=0; i<root.num_branches(); ++i) {
+    const auto& child = root.children[i];
+    if (child && child->proof == Proof::loss)
+      return i;
+    if (child && child->proof == Proof::win)
+      continue;
+    if (best < 0 || root.visit_counts[i] > root.visit_counts[best])
+      best = i;
   }
-  return new_node;
+  if (best < 0) {
+    // Every move loses.
+    auto max_it = std::max_element(root.visit_counts.begin(), root.visit_counts.end());
+    best = max_it - root.visit_counts.begin();
+  }
+  return best;
 }
 
 
+int ZeroAgent::gumbel_search(ZeroNode& root, int max_rounds, bool add_noise,
+                             std::vector<float>& policy, int& rounds) {
+  auto num_branches = root.num_branches();
+  rounds = 0;
 
-Move ZeroAgent::select_branch(const ZeroNode& node) const {
-  auto score_branch = [&] (Move move) {
-    auto q = node.expected_value(move);
-    auto p = node.prior(move);
-    auto n = node.visit_count(move);
-    return q + c_uct * p * sqrt(node.total_visit_count) / (n + 1);
+  std::vector<float> logits(num_branches);
+  std::vector<float> scores(num_branches);
+  float prior_sum = 0.0;
+  for (auto i=0; i<num_branches; ++i) {
+    logits[i] = std::log(std::max(root.priors[i], 1e-12f));
+    prior_sum += root.priors[i];
+  }
+  // Gumbel noise and prior logits.
+  std::extreme_value_distribution<float> gumbel_dist;
+  for (auto i=0; i<num_branches; ++i)
+    scores[i] = logits[i] + (add_noise ? gumbel_dist(rng) : 0.0f);
+
+  // Monotonic transform of Q-values, with Q normalized from [-1, 1] to [0, 1].
+  float sigma_scale = 0.0;
+  auto sigma = [&sigma_scale](float q) {
+    return sigma_scale * 0.5f * (q + 1.0f);
   };
-  auto max_it = std::max_element(node.branches.begin(), node.branches.end(),
-                                 [score_branch] (const auto& p1, const auto& p2) {
-                                   return score_branch(p1.first) < score_branch(p2.first);
-                                 });
-  assert(max_it != node.branches.end());
-  return max_it->first;
+  auto update_sigma_scale = [&]() {
+    auto max_visits = *std::max_element(root.visit_counts.begin(), root.visit_counts.end());
+    sigma_scale = (GUMBEL_C_VISIT + max_visits) * GUMBEL_C_SCALE;
+  };
+
+  // Order considered moves by Gumbel plus logit plus transformed Q-value.
+  std::vector<float> ranks(num_branches);
+  auto rank = [&](std::vector<int>& branches) {
+    update_sigma_scale();
+    for (auto b : branches)
+      ranks[b] = scores[b] + (root.visit_counts[b] ? sigma(root.expected_value(b)) : 0.0f);
+    std::stable_sort(branches.begin(), branches.end(),
+                     [&ranks](int a, int b) { return ranks[a] > ranks[b]; });
+  };
+
+  // Sample the moves to consider without replacement, as the top-k moves by
+  // Gumbel plus logit.
+  std::vector<int> considered(num_branches);
+  std::iota(considered.begin(), considered.end(), 0);
+  rank(considered);
+  considered.resize(std::min({num_branches, gumbel_max_considered, std::max(max_rounds, 1)}));
+
+  // Sequential halving: split the rounds evenly among the phases, and within
+  // each phase among the remaining moves, then keep the better half.
+  int num_phases = std::max(1, static_cast<int>(std::ceil(std::log2(considered.size()))));
+  while (rounds < max_rounds) {
+    int rounds_per_move = std::max(1, max_rounds / (num_phases * static_cast<int>(considered.size())));
+    for (auto branch : considered) {
+      for (auto i=0; i<rounds_per_move && rounds < max_rounds && root.proof == Proof::none; ++i) {
+        search_round(root, branch);
+        ++rounds;
+      }
+    }
+    if (root.proof != Proof::none)
+      break;
+    rank(considered);
+    if (considered.size() == 1)
+      break;
+    considered.resize((considered.size() + 1) / 2);
+  }
+
+  // Improved policy: softmax of logits plus transformed completed Q-values.
+  // Unvisited moves are completed with a mix of the network value and the
+  // prior-weighted Q of visited moves.
+  float visited_prior = 0.0;
+  float visited_q = 0.0;
+  int total_visits = 0;
+  for (auto i=0; i<num_branches; ++i) {
+    if (root.visit_counts[i] == 0)
+      continue;
+    visited_prior += root.priors[i] / prior_sum;
+    visited_q += root.priors[i] / prior_sum * root.expected_value(i);
+    total_visits += root.visit_counts[i];
+  }
+  float mixed_value = root.value;
+  if (visited_prior > 0.0)
+    mixed_value = (root.value + total_visits * visited_q / visited_prior) / (1.0 + total_visits);
+
+  update_sigma_scale();
+  policy.resize(num_branches);
+  for (auto i=0; i<num_branches; ++i) {
+    auto q = root.visit_counts[i] ? root.expected_value(i) : mixed_value;
+    policy[i] = logits[i] + sigma(q);
+  }
+  auto max_logit = *std::max_element(policy.begin(), policy.end());
+  float total = 0.0;
+  for (auto& p : policy) {
+    p = std::exp(p - max_logit);
+    total += p;
+  }
+  for (auto& p : policy)
+    p /= total;
+
+  return considered.front();
+}
+
+
+bool ZeroAgent::is_search_settled(const ZeroNode& root) {
+  auto best = best_branch(root);
+  int second = -1;
+  for (auto i=0; i<root.num_branches(); ++i) {
+    if (i != best && (second < 0 || root.visit_counts[i] > root.visit_counts[second]))
+      second = i;
+  }
+  if (second < 0 || root.visit_counts[second] == 0)
+    return true;
+  return root.visit_counts[best] >= 2 * root.visit_counts[second] &&
+    root.expected_value(second) <= root.expected_value(best);
+}
+
+
+bool ZeroAgent::is_search_decided(const ZeroNode& root, int remaining_rounds) {
+  if (root.num_branches() <= 1)
+    return true;
+  int best = 0;
+  int second = 0;
+  for (auto count : root.visit_counts) {
+    if (count > best) {
+      second = best;
+      best = count;
+    }
+    else if (count > second)
+      second = count;
+  }
+  return second + remaining_rounds < best;
+}
+
+
+std::shared_ptr<ZeroNode> ZeroAgent::create_node(ConstGameStatePtr game_state,
+                                                 const std::vector<Point>& ko_points,
+                                                 bool is_root,
+                                                 bool add_noise) {
+
+  ++stats.num_evaluations;
+
+  // Symmetries are applied while encoding directly into the reused input
+  // tensor.
+  if (! symmetry_ensemble)
+    // Random rotation or reflection:
+    transforms[0] = Dihedral();
+  for (size_t i=0; i<transforms.size(); ++i)
+    encoder->encode_into(*game_state, ko_points, input_batch.data() + i * encoder->input_size(),
+                         transforms[i]);
+
+  evaluator->evaluate(input_batch.data(), transforms.size(),
+                      batch_priors.data(), batch_values.data());
+  auto priors_data = batch_priors.data();
+  auto values_data = batch_values.data();
+
+  // Apply reverse transformation to the priors.
+  float value;
+  if (transforms.size() == 1) {
+    encoder->untransform_policy(priors_data, transforms[0], move_priors.data());
+    value = values_data[0];
+  }
+  else {
+    // Average over the symmetries.
+    const float weight = 1.0 / transforms.size();
+    std::fill(move_priors.begin(), move_priors.end(), 0.0);
+    value = 0.0;
+    for (size_t i=0; i<transforms.size(); ++i) {
+      encoder->untransform_policy(priors_data + i * encoder->num_moves(), transforms[i],
+                                  symmetry_priors.data());
+      for (auto j=0; j<encoder->num_moves(); ++j)
+        move_priors[j] += weight * symmetry_priors[j];
+      value += weight * values_data[i];
+    }
+  }
+
+  return node_pool.make(game_state, value,
+                        move_priors.data(),
+                        *encoder,
+                        add_noise,
+                        is_root);
+}
+
+
+void ZeroAgent::prune_tree(ZeroNode& root) {
+  // Only this agent's share of the excess is released, since other agents
+  // may be using the rest of a shared budget.
+  const long target = node_pool.prune_target(PRUNE_TARGET);
+  const long initial_size = node_pool.size();
+
+  // Release every subtree whose edge has at most `threshold` visits, doubling
+  // the threshold until enough nodes are released.  Visits only decrease
+  // going down the tree, so each pass releases whole subtrees from the top
+  // and never looks inside a released one.
+  std::vector<ZeroNode*> stack;
+  std::unordered_set<ZeroNode*> seen;
+  for (int threshold=1; node_pool.size() > target && threshold <= root.total_visit_count; threshold *= 2) {
+    stack.assign(1, &root);
+    seen.clear();
+    while (! stack.empty()) {
+      auto node = stack.back();
+      stack.pop_back();
+      for (auto i=0; i<node->num_branches(); ++i) {
+        auto& child = node->children[i];
+        // Proven children are kept, since parent proofs depend on them.
+        if (! child || child->proof != Proof::none)
+          continue;
+        if (node->visit_counts[i] <= threshold)
+          child.reset();
+        else if (seen.insert(child.get()).second)
+          stack.push_back(child.get());
+      }
+    }
+  }
+  stats.num_pruned += initial_size - node_pool.size();
+}
+
+
+
+int ZeroAgent::select_branch(const ZeroNode& node) const {
+  assert(node.num_branches() > 0);
+  return select_puct(node.priors.data(), node.visit_counts.data(),
+                     node.total_values.data(), node.num_branches(),
+                     c_uct * std::sqrt(static_cast<float>(node.total_visit_count)));
 }
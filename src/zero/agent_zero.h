@@ -3,21 +3,18 @@
 
 #include <memory>
 #include <optional>
-#include <torch/script.h> // One-stop header.
+#include <unordered_map>
+#include <vector>
 
 #include "encoder.h"
+#include "evaluator.h"
 #include "experience.h"
 #include "../agent_base.h"
+#include "../node_pool.h"
 
-class Branch {
-public:
-  float prior;
-  int visit_count = 0;
-  float total_value = 0.0;
-
-public:
-  Branch(float prior) : prior(prior) {}
-};
+/// Game-theoretic result of a node, from the perspective of its player to
+/// move.
+enum class Proof : int8_t { none, win, loss };
 
 class ZeroNode {
 
@@ -27,59 +24,258 @@ class ZeroNode {
 
 public:
   ConstGameStatePtr game_state;
-  std::weak_ptr<ZeroNode> parent;
-  std::optional<Move> last_move;
-  std::unordered_map<Move, std::shared_ptr<ZeroNode>, MoveHash> children;
-  std::unordered_map<Move, Branch, MoveHash> branches;
+
+  // Statistics for the branches that have been added so far, in order of
+  // decreasing prior.  These are stored as parallel arrays so that branch
+  // selection can score all branches with vector instructions.
+  std::vector<Move> moves;
+  std::vector<float> priors;
+  std::vector<int> visit_counts;
+  std::vector<float> total_values;
+  // Child node for each branch, or null if the branch hasn't been expanded.
+  std::vector<std::shared_ptr<ZeroNode>> children;
+
+  // Priors of branches that were zeroed once proven lost, as (branch, prior)
+  // pairs, so that analysis still reports them.
+  std::vector<std::pair<int, float>> lost_priors;
+
+  // Moves that haven't been added as branches yet, as (prior, encoder move
+  // index) pairs in a max heap on the prior.  Only empty points and pass are
+  // included; the full legality check is deferred until a move is added.
+  std::vector<std::pair<float, int>> candidates;
+
   float value;
+  Proof proof = Proof::none;
   int total_visit_count = 1;
+  // Sum of values backed up through this node's branches.
+  float total_value = 0.0;
   bool terminal;
+  // Most recent search round that passed through this node, used to detect
+  // cycles in graph search.
+  long last_round = -1;
 
+  /// Priors are indexed by encoder move index.  If expand_all is false, only
+  /// the legal move with the highest prior is added as a branch, and further
+  /// branches are added with widen().  Noise requires expand_all.
   ZeroNode(ConstGameStatePtr game_state, float value,
-           std::unordered_map<Move, float, MoveHash> priors,
-           std::weak_ptr<ZeroNode> parent,
-           std::optional<Move> last_move,
-           bool add_noise);
+           const float* move_priors,
+           const Encoder& encoder,
+           bool add_noise,
+           bool expand_all = true);
+
+  /// Reinitialize a recycled node as if newly constructed.
+  void init(ConstGameStatePtr game_state, float value,
+            const float* move_priors,
+            const Encoder& encoder,
+            bool add_noise,
+            bool expand_all = true);
 
-  void add_child(Move move, std::shared_ptr<ZeroNode> child) {
-    children.emplace(move, child);
+  /// Drop references to children and the game state before recycling.
+  void release() {
+    children.clear();
+    game_state.reset();
   }
 
-  // More efficient to work with the children.find iterator directly if
-  // possible, to avoid repeated calls.
+  int num_branches() const { return moves.size(); }
 
-  // bool has_child(Move move) {
-  //   return children.find(move) != children.end();
-  // }
+  /// Add the legal candidate move with the highest prior as a branch.  Returns
+  /// false if there are no more legal moves.
+  bool widen(const Encoder& encoder);
 
-  // std::shared_ptr<ZeroNode> get_child(Move move) {
-  //   return children.find(move)->second;
-  // }
+  /// Index of the branch for a move, or -1 if the move isn't a legal branch.
+  int branch_index(Move m) const;
 
-  void record_visit(Move m, float val);
+  /// Prior of a branch as evaluated, including for proven losses, whose entry
+  /// in priors is zeroed to stop exploring them.
+  float prior(int branch) const;
+
+  void record_visit(int branch, float val) {
+    ++total_visit_count;
+    ++visit_counts[branch];
+    total_values[branch] += val;
+    total_value += val;
+  }
 
-  float expected_value(Move m) const;
+  /// Update the proof after a visit through a branch.  The node is won if the
+  /// branch leads to a proven loss for the opponent, and lost if every legal
+  /// move leads to a proven win for the opponent.  Returns true if the node
+  /// became proven.
+  bool update_proof(int branch);
 
-  float prior(Move m) const {
-    return branches.find(m)->second.prior;
+  /// Value estimate for the node, averaged over its own evaluation and all
+  /// visits through it.
+  float mean_value() const {
+    if (proof != Proof::none)
+      return proof == Proof::win ? 1.0 : -1.0;
+    if (terminal)
+      return value;
+    return (value + total_value) / total_visit_count;
   }
 
-  int visit_count(Move m) const {
-    auto it = branches.find(m);
-    if (it != branches.end())
-      return it->second.visit_count;
-    return 0;
+  float expected_value(int branch) const {
+    if (visit_counts[branch] == 0)
+      return 0.0;
+    return total_values[branch] / visit_counts[branch];
+  }
+};
+
+/// Counters accumulated over calls to ZeroAgent::select_move.
+struct SearchStats {
+  int num_moves = 0;
+  long num_rounds = 0;
+  // Rounds skipped by early stopping.
+  long rounds_saved = 0;
+  // Moves searched with the full number of rounds, as opposed to a fast search
+  // under playout cap randomization.
+  int num_full_searches = 0;
+  // Network evaluations, and expansions that were merged with an existing node
+  // in graph search instead of being evaluated.
+  long num_evaluations = 0;
+  long num_transpositions = 0;
+  // Nodes released to stay within the node budget.
+  long num_pruned = 0;
+};
+
+/// Identifies positions that can share a node in graph search.  Besides the
+/// stones and player to move, this includes the points that are illegal due to
+/// ko and whether the last move was a pass (so that a second pass ends the
+/// game).  Legality further down the tree can still depend on history, which
+/// is ignored.
+struct PositionKey {
+  uint64_t hash;
+  Player next_player;
+  bool last_move_pass;
+  std::vector<Point> ko_points;
+
+  explicit PositionKey(const GameState& game_state) :
+    PositionKey(game_state, game_state.ko_points()) {}
+  PositionKey(const GameState& game_state, std::vector<Point> ko_points);
+
+  bool operator==(const PositionKey& rhs) const {
+    return hash == rhs.hash && next_player == rhs.next_player &&
+      last_move_pass == rhs.last_move_pass && ko_points == rhs.ko_points;
+  }
+};
+
+struct PositionKeyHash {
+  std::size_t operator()(const PositionKey& key) const {
+    auto hash = key.hash ^ (static_cast<uint64_t>(key.next_player) << 1) ^ key.last_move_pass;
+    for (const auto& point : key.ko_points)
+      hash ^= PointHash()(point) * 0x9E3779B97F4A7C15ULL;
+    return hash;
   }
 };
 
 class ZeroAgent : public Agent {
-  torch::jit::script::Module model;
+  std::shared_ptr<Evaluator> evaluator;
   std::shared_ptr<Encoder> encoder;
   int num_rounds;
   float c_uct;
 
   std::shared_ptr<ExperienceCollector> collector;
 
+  // If true, each position is evaluated under all 8 board symmetries in a
+  // single batch and the results are averaged.  Otherwise a single random
+  // symmetry is used.
+  bool symmetry_ensemble = false;
+
+  // If true, Dirichlet noise is added to the root priors of full searches
+  // for exploration in self-play.  Off for play, evaluation and analysis.
+  bool root_noise = false;
+
+  // If true, stop searching once the most visited root move can't be
+  // overtaken in the remaining rounds.  Only applies to moves that are
+  // selected greedily and aren't recorded as policy targets.
+  bool early_stopping = false;
+
+  // If true, use Gumbel AlphaZero at the root: sample the moves to consider
+  // without replacement using Gumbel noise on the prior logits, allocate
+  // rounds among them with sequential halving, and record an improved policy
+  // built from completed Q-values as the training target.  This replaces
+  // Dirichlet noise and PUCT selection at the root.
+  bool gumbel = false;
+  int gumbel_max_considered = 16;
+  // Scale of the Q-value transform, sigma(q) = (c_visit + max n) * c_scale * q,
+  // with q normalized to [0, 1].  Values from the Gumbel AlphaZero paper.
+  constexpr static float GUMBEL_C_VISIT = 50.0;
+  constexpr static float GUMBEL_C_SCALE = 1.0;
+
+  // If true, merge transpositions so that the search forms a directed acyclic
+  // graph.  Nodes are shared between parents, and edge statistics stay in the
+  // parent.  When an edge's mean value disagrees with that of a shared child
+  // that has been updated through other paths, the edge is corrected towards
+  // the child's value instead of descending further.
+  bool graph_search = false;
+  std::unordered_map<PositionKey, std::weak_ptr<ZeroNode>, PositionKeyHash> transpositions;
+  constexpr static float GRAPH_VALUE_TOLERANCE = 0.01;
+  long round_id = 0;
+
+  // Playout cap randomization: when fast_rounds > 0, each move uses a full
+  // search of num_rounds with probability full_search_probability, and
+  // otherwise a fast search of fast_rounds without root noise.  Only full
+  // searches are recorded as policy targets; fast searches are recorded as
+  // value-only positions if record_fast_searches is set.
+  int fast_rounds = 0;
+  float full_search_probability = 1.0;
+  bool record_fast_searches = false;
+
+  // Resign when the value of the most visited root move falls below this
+  // threshold.  Resignation is disabled if not set.
+  std::optional<float> resign_threshold;
+  // Lowest root value seen since the last reset, used to calibrate the
+  // threshold.
+  float min_root_value = 1.0;
+
+  // Nodes are allocated from a pool that recycles the nodes of earlier
+  // searches.  If the pool has a budget, the least visited subtrees are
+  // released when it is exhausted; their statistics remain on the parent's
+  // edges and they are evaluated again if the search returns to them.
+  NodePool<ZeroNode> node_pool;
+  // Fraction of the budget to prune down to, so that pruning isn't repeated
+  // every round.
+  constexpr static float PRUNE_TARGET = 0.75;
+  // Fraction of the budget a tree may grow to while pondering.  This leaves
+  // room for the searches of other agents sharing the budget, and for this
+  // agent's own search once the opponent moves.
+  constexpr static float PONDER_BUDGET_FRACTION = 0.5;
+
+  // Under time control, search runs until the budget's target once the best
+  // move is settled, or until its maximum, and the round limit is ignored.
+  // Gumbel search plans its rounds up front, so it uses the rate measured in
+  // earlier searches to fit the target instead.
+  std::optional<TimeBudget> time_budget;
+  double rounds_per_second = 0.0;
+
+  // If true, the tree is kept after each move and the subtree for the next
+  // position searched is reused, including any search done while pondering.
+  // Reused visits count towards the round limit.  Not used with Gumbel
+  // search, which plans its rounds from a fresh root.
+  bool tree_reuse = false;
+  std::shared_ptr<ZeroNode> search_root;
+  // Reuse is attempted for positions up to this many moves below the
+  // previous root.
+  constexpr static int MAX_REUSE_DEPTH = 2;
+  // Longest principal variation reported by analysis.
+  constexpr static int MAX_PV_LENGTH = 30;
+
+  SearchStats stats;
+
+  // Nodes and selected branches from the root down to the current leaf, used
+  // to back up the leaf value.
+  std::vector<std::pair<ZeroNode*, int>> path;
+
+  // Evaluator input and outputs, reused for every evaluation to avoid
+  // allocating per leaf.  The batch holds one entry per evaluated symmetry.
+  std::vector<float> input_batch;
+  std::vector<float> batch_priors;
+  std::vector<float> batch_values;
+  // Priors for the most recent evaluation, indexed by encoder move index.
+  std::vector<float> move_priors;
+  std::vector<float> symmetry_priors;
+  // Symmetry for each batch entry: all 8 for a symmetry ensemble, or a single
+  // one that is drawn at random for each evaluation.
+  std::vector<Dihedral> transforms;
+
   // If True, always select moves that maximize visit count.  Otherwise, initial
   // moves are selected in proportion to visit count.
   bool greedy;
@@ -88,12 +284,16 @@ class ZeroAgent : public Agent {
   constexpr static int REFERENCE_GREEDY_MOVE_THRESHOLD = 30;
 
 public:
-  ZeroAgent(torch::jit::script::Module model,
+  ZeroAgent(std::shared_ptr<Evaluator> evaluator,
             std::shared_ptr<Encoder> encoder,
             int num_rounds,
             bool greedy = true,
             float c_uct = 1.5) :
-    model(model), encoder(encoder), num_rounds(num_rounds), c_uct(c_uct), greedy(greedy) {}
+    evaluator(evaluator), encoder(encoder), num_rounds(num_rounds), c_uct(c_uct), greedy(greedy) {
+    allocate_input_batch(1);
+    move_priors.resize(encoder->num_moves());
+    symmetry_priors.resize(encoder->num_moves());
+  }
 
   Move select_move(const GameState&);
 
@@ -101,11 +301,123 @@ public:
     collector = c;
   }
 
+  void set_symmetry_ensemble(bool enabled) {
+    symmetry_ensemble = enabled;
+    allocate_input_batch(enabled ? 8 : 1);
+  }
+
+  void set_root_noise(bool enabled) {
+    root_noise = enabled;
+  }
+
+  void set_early_stopping(bool enabled) {
+    early_stopping = enabled;
+  }
+
+  void set_graph_search(bool enabled) {
+    graph_search = enabled;
+  }
+
+  void set_gumbel(bool enabled, int max_considered = 16) {
+    gumbel = enabled;
+    gumbel_max_considered = max_considered;
+  }
+
+  void set_playout_cap(int fast_rounds, float full_search_probability,
+                       bool record_fast_searches = false) {
+    this->fast_rounds = fast_rounds;
+    this->full_search_probability = full_search_probability;
+    this->record_fast_searches = record_fast_searches;
+  }
+
+  /// Limit the number of live nodes.  The budget may be shared with other
+  /// agents.  The limit is soft: it can be exceeded when nothing is left to
+  /// prune besides the root, its proven children and the nodes held by other
+  /// agents sharing the budget.
+  void set_node_budget(std::shared_ptr<NodeBudget> budget) {
+    node_pool.set_budget(budget);
+  }
+
+  void set_time_budget(std::optional<TimeBudget> budget) override {
+    time_budget = budget;
+  }
+
+  void set_tree_reuse(bool enabled) {
+    tree_reuse = enabled;
+    if (! enabled)
+      search_root.reset();
+  }
+
+  /// Search until stopped, the position is proven, or the tree reaches its
+  /// share of the node budget.  Requires tree reuse.
+  void ponder(const GameState&, const std::atomic<bool>& stop) override;
+
+  void analyze(const GameState&, const std::atomic<bool>& stop,
+               double interval, const AnalysisCallback& report) override;
+  bool supports_analysis() const override { return true; }
+
+  /// Search the position for the configured number of rounds, without noise,
+  /// and return the analysis of the visited root moves, most visited first.
+  /// Gumbel agents report the visits of their sequential halving.
+  std::vector<MoveAnalysis> analyze_position(const GameState&);
+
+  void set_resign_threshold(std::optional<float> threshold) {
+    resign_threshold = threshold;
+  }
+
+  float get_min_root_value() const { return min_root_value; }
+  void reset_min_root_value() { min_root_value = 1.0; }
+
+  const SearchStats& get_stats() const { return stats; }
+
 private:
+  void allocate_input_batch(int batch_size) {
+    input_batch.resize(batch_size * encoder->input_size());
+    batch_priors.resize(batch_size * encoder->num_moves());
+    batch_values.resize(batch_size);
+    transforms.clear();
+    for (auto i=0; i<batch_size; ++i)
+      transforms.emplace_back(i % 4, i > 3);
+  }
+
+  /// Evaluate a position and create its node.  Root nodes are fully expanded,
+  /// while other nodes add branches lazily as they are visited.
+  std::shared_ptr<ZeroNode> create_node(ConstGameStatePtr game_state,
+                                        bool is_root = false,
+                                        bool add_noise = false) {
+    return create_node(game_state, game_state->ko_points(), is_root, add_noise);
+  }
+  /// As above, given the position's ko_points().
   std::shared_ptr<ZeroNode> create_node(ConstGameStatePtr game_state,
-                                        std::optional<Move> move = std::nullopt,
-                                        std::weak_ptr<ZeroNode> parent = std::weak_ptr<ZeroNode>());
-  Move select_branch(const ZeroNode& node) const;
+                                        const std::vector<Point>& ko_points,
+                                        bool is_root = false,
+                                        bool add_noise = false);
+  /// The subtree of the previous search for the position, fully expanded, or
+  /// null if there is none.  The rest of the previous tree is released.
+  std::shared_ptr<ZeroNode> reuse_tree(const GameState& game_state);
+  /// Run a single round of search: descend to a leaf, expand it, and back up
+  /// the value.
+  /// If forced_branch is non-negative, it is selected at the root.
+  void search_round(ZeroNode& root, int forced_branch = -1);
+  /// Run a Gumbel AlphaZero search of up to max_rounds at the root.  Returns
+  /// the selected branch and fills `policy` with the improved policy for each
+  /// branch.  Sets `rounds` to the number of rounds performed.
+  int gumbel_search(ZeroNode& root, int max_rounds, bool add_noise,
+                    std::vector<float>& policy, int& rounds);
+  int select_branch(const ZeroNode& node) const;
+  /// Branch to play at the root: a proven win if there is one, otherwise the
+  /// most visited branch that isn't a proven loss.
+  static int best_branch(const ZeroNode& root);
+  /// True if further rounds can't change the most visited root move.
+  static bool is_search_decided(const ZeroNode& root, int remaining_rounds);
+  /// True if the best root move is well ahead of the runner-up, in visits
+  /// and without a worse value, so that more time is unlikely to change it.
+  static bool is_search_settled(const ZeroNode& root);
+  /// Visited root moves with their principal variations, most visited first.
+  static std::vector<MoveAnalysis> root_analysis(const ZeroNode& root);
+  /// Release subtrees below the root with few visits until the node budget
+  /// is below its target, or nothing is left to release.
+  void prune_tree(ZeroNode& root);
 };
 
 #endif // AGENT_ZERO_H
@@ -0,0 +1,179 @@
+#include <algorithm>
+#include <chrono>
+
+#include "batching_evaluator.h"
+
+
+BatchingEvaluator::BatchingEvaluator(std::shared_ptr<Evaluator> evaluator,
+                                     int input_size, int num_moves,
+                                     int max_batch_size, double max_wait) :
+  evaluator(evaluator), input_size(input_size), num_moves(num_moves),
+  max_batch_size(max_batch_size), max_wait(max_wait) {
+  worker = std::thread(&BatchingEvaluator::run, this);
+}
+
+
+BatchingEvaluator::~BatchingEvaluator() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  work_ready.notify_one();
+  worker.join();
+}
+
+
+std::shared_ptr<Evaluator> BatchingEvaluator::make_client(int* id) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto client = next_id++;
+  clients.emplace(client, ClientState());
+  if (id)
+    *id = client;
+  return std::make_shared<Client>(*this, client);
+}
+
+
+ClientStats BatchingEvaluator::client_stats(int id) {
+  std::lock_guard<std::mutex> lock(mutex);
+  return clients.at(id).stats;
+}
+
+
+double BatchingEvaluator::mean_batch_size() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return num_batches ? static_cast<double>(num_positions) / num_batches : 0.0;
+}
+
+
+void BatchingEvaluator::submit(int client, const float* input, int batch_size,
+                               float* priors, float* values) {
+  Request request{input, batch_size, priors, values, Timer()};
+  std::unique_lock<std::mutex> lock(mutex);
+  auto& state = clients.at(client);
+  state.queue.push_back(&request);
+  ++num_pending;
+  work_ready.notify_one();
+  results_ready.wait(lock, [&request]() { return request.done; });
+
+  auto latency = request.timer.elapsed();
+  auto& stats = state.stats;
+  ++stats.num_requests;
+  stats.num_positions += batch_size;
+  stats.total_latency += latency;
+  stats.max_latency = std::max(stats.max_latency, latency);
+}
+
+
+void BatchingEvaluator::set_searching(int client, bool searching) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    clients.at(client).searching = searching;
+  }
+  // The remaining searches may now all be waiting.
+  work_ready.notify_one();
+}
+
+
+void BatchingEvaluator::disconnect(int client) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    // A client's requests block, so nothing of its own is still queued.
+    clients.erase(client);
+  }
+  // The remaining clients may now all be waiting.
+  work_ready.notify_one();
+}
+
+
+std::vector<BatchingEvaluator::Request*> BatchingEvaluator::take_batch() {
+  std::vector<Request*> batch;
+  int size = 0;
+  const auto start = clients.lower_bound(next_client);
+  // Keep taking a request from each client in turn until the batch is full.
+  bool added = true;
+  while (added) {
+    added = false;
+    auto it = start;
+    for (size_t i=0; i<clients.size(); ++i, ++it) {
+      if (it == clients.end())
+        it = clients.begin();
+      auto& queue = it->second.queue;
+      if (queue.empty())
+        continue;
+      auto request = queue.front();
+      if (! batch.empty() && size + request->batch_size > max_batch_size) {
+        // Start the next batch with the client that missed out.
+        next_client = it->first;
+        return batch;
+      }
+      batch.push_back(request);
+      size += request->batch_size;
+      queue.pop_front();
+      --num_pending;
+      added = true;
+      next_client = it->first + 1;
+    }
+  }
+  return batch;
+}
+
+
+void BatchingEvaluator::run() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    work_ready.wait(lock, [this]() { return stopping || num_pending > 0; });
+    if (stopping)
+      return;
+
+    // Wait for a fuller batch, unless every client that is searching or has
+    // a request is already waiting, or the oldest request times out.
+    Request* oldest = nullptr;
+    int pending_positions = 0;
+    int num_active = 0;
+    for (const auto& [id, client] : clients) {
+      num_active += client.searching || ! client.queue.empty();
+      for (auto request : client.queue) {
+        pending_positions += request->batch_size;
+        if (! oldest || request->timer.elapsed() > oldest->timer.elapsed())
+          oldest = request;
+      }
+    }
+    auto remaining = max_wait - oldest->timer.elapsed();
+    if (pending_positions < max_batch_size && num_pending < num_active && remaining > 0) {
+      work_ready.wait_for(lock, std::chrono::duration<double>(remaining));
+      continue;
+    }
+
+    auto batch = take_batch();
+    int size = 0;
+    for (auto request : batch)
+      size += request->batch_size;
+    input_batch.resize(size * input_size);
+    batch_priors.resize(size * num_moves);
+    batch_values.resize(size);
+    int offset = 0;
+    for (auto request : batch) {
+      std::copy_n(request->input, request->batch_size * input_size,
+                  input_batch.data() + offset * input_size);
+      offset += request->batch_size;
+    }
+
+    // Clients stay blocked while their requests are evaluated, so the
+    // requests remain valid without the lock.
+    lock.unlock();
+    evaluator->evaluate(input_batch.data(), size, batch_priors.data(), batch_values.data());
+    lock.lock();
+
+    offset = 0;
+    for (auto request : batch) {
+      std::copy_n(batch_priors.data() + offset * num_moves, request->batch_size * num_moves,
+                  request->priors);
+      std::copy_n(batch_values.data() + offset, request->batch_size, request->values);
+      offset += request->batch_size;
+      request->done = true;
+    }
+    ++num_batches;
+    num_positions += size;
+    results_ready.notify_all();
+  }
+}
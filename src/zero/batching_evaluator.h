@@ -0,0 +1,127 @@
+#ifndef BATCHING_EVALUATOR_H
+#define BATCHING_EVALUATOR_H
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "evaluator.h"
+#include "../utils.h"
+
+/// Evaluation counters for one client of a BatchingEvaluator.
+struct ClientStats {
+  long num_requests = 0;
+  long num_positions = 0;
+  // Seconds from submitting a request to receiving its results.
+  double total_latency = 0.0;
+  double max_latency = 0.0;
+
+  double mean_latency() const {
+    return num_requests ? total_latency / num_requests : 0.0;
+  }
+};
+
+
+/// Combines evaluations from concurrent searches into shared batches for a
+/// single evaluator, which runs on a worker thread.  Each search evaluates
+/// through its own client, created with make_client().  Client evaluations
+/// block until their results are ready.
+///
+/// A batch is run once it holds max_batch_size positions, every client with a
+/// search in progress (see Evaluator::begin_search()) has a request waiting,
+/// or the oldest request has waited max_wait seconds.  Idle clients, such as
+/// GTP sessions between commands, don't hold up batches.
+/// Requests are taken round-robin over the clients, starting after the last
+/// client served, so that a full batch doesn't favor any one of them.  A
+/// request larger than max_batch_size is run on its own.
+class BatchingEvaluator {
+  struct Request {
+    const float* input;
+    int batch_size;
+    float* priors;
+    float* values;
+    Timer timer;
+    bool done = false;
+  };
+
+  struct ClientState {
+    std::deque<Request*> queue;
+    ClientStats stats;
+    // Between begin_search() and end_search(), so more requests will follow.
+    bool searching = false;
+  };
+
+  class Client : public Evaluator {
+    BatchingEvaluator& owner;
+    int id;
+
+  public:
+    Client(BatchingEvaluator& owner, int id) : owner(owner), id(id) {}
+    ~Client() { owner.disconnect(id); }
+
+    void evaluate(const float* input, int batch_size, float* priors, float* values) {
+      owner.submit(id, input, batch_size, priors, values);
+    }
+    void begin_search() { owner.set_searching(id, true); }
+    void end_search() { owner.set_searching(id, false); }
+  };
+
+  std::shared_ptr<Evaluator> evaluator;
+  int input_size;
+  int num_moves;
+  int max_batch_size;
+  double max_wait;
+
+  std::mutex mutex;
+  // Signals the worker of new requests, and clients of finished batches.
+  std::condition_variable work_ready;
+  std::condition_variable results_ready;
+  // Connected clients by id.
+  std::map<int, ClientState> clients;
+  int next_id = 0;
+  int num_pending = 0;
+  // Id of the client to take requests from first in the next batch.
+  int next_client = 0;
+  bool stopping = false;
+  long num_batches = 0;
+  long num_positions = 0;
+
+  std::vector<float> input_batch;
+  std::vector<float> batch_priors;
+  std::vector<float> batch_values;
+  std::thread worker;
+
+  void submit(int client, const float* input, int batch_size, float* priors, float* values);
+  void set_searching(int client, bool searching);
+  void disconnect(int client);
+  void run();
+  /// Take the requests for the next batch.  Requires the lock.
+  std::vector<Request*> take_batch();
+
+public:
+  /// max_wait is in seconds.
+  BatchingEvaluator(std::shared_ptr<Evaluator> evaluator,
+                    int input_size, int num_moves,
+                    int max_batch_size, double max_wait);
+  ~BatchingEvaluator();
+
+  BatchingEvaluator(const BatchingEvaluator&) = delete;
+  BatchingEvaluator& operator=(const BatchingEvaluator&) = delete;
+
+  /// An evaluator for one search.  Clients must be destroyed before the
+  /// BatchingEvaluator, and each client must only be used by one thread at a
+  /// time.  The client's id, for client_stats(), is set in `id` if given.
+  std::shared_ptr<Evaluator> make_client(int* id = nullptr);
+
+  /// Stats of a connected client.  Throws std::out_of_range once the client
+  /// has been destroyed.
+  ClientStats client_stats(int id);
+  /// Mean number of positions per batch run so far.
+  double mean_batch_size();
+};
+
+#endif // BATCHING_EVALUATOR_H
@@ -1,8 +1,12 @@
 #ifndef DIHEDRAL_H
 #define DIHEDRAL_H
 
+#include <array>
+#include <cassert>
+#include <vector>
 #include <torch/torch.h>
 
+#include "../hash.h"
 #include "../myrand.h"
 
 /// Define dihedral rotations and reflections of the board tensors.
@@ -29,6 +33,19 @@ public:
   /// Specified transformation, for testing
   Dihedral(int rotations, bool flip) : rotations{rotations}, flip{flip} {}
 
+  bool is_identity() const {
+    return rotations == 0 && (! flip);
+  }
+
+  /// Map from each row-major point index on a square board to its index after
+  /// the forward transformation, i.e., forward(x)[point_map[i]] = x[i].  The
+  /// same table converts a policy from the transformed frame back to the
+  /// original one.
+  const std::vector<int>& point_map(int board_size) const {
+    assert(1 <= board_size && board_size <= HASH_MAX_BOARD);
+    return point_tables()[board_size - 1][(flip ? 4 : 0) + rotations];
+  }
+
   torch::Tensor forward(const torch::Tensor& input_tensor) const {
     assert(input_tensor.dim() == 3);
     if (rotations == 0 && (! flip))
@@ -53,6 +70,40 @@ public:
     return new_tensor;
   }
 
+private:
+
+  using PointTables = std::array<std::array<std::vector<int>, 8>, HASH_MAX_BOARD>;
+
+  /// Tables for all 8 transformations and all supported board sizes, built
+  /// once on first use.
+  static const PointTables& point_tables() {
+    static const PointTables tables = [] {
+      PointTables tables;
+      for (int n=1; n<=HASH_MAX_BOARD; ++n) {
+        for (int t=0; t<8; ++t) {
+          auto& table = tables[n - 1][t];
+          table.resize(n * n);
+          for (int r=0; r<n; ++r) {
+            for (int c=0; c<n; ++c) {
+              // Follow the same steps as forward(): flip the rows, then rotate
+              // counterclockwise.
+              int row = (t > 3) ? n - 1 - r : r;
+              int col = c;
+              for (int k=0; k < t % 4; ++k) {
+                int new_row = n - 1 - col;
+                col = row;
+                row = new_row;
+              }
+              table[r * n + c] = row * n + col;
+            }
+          }
+        }
+      }
+      return tables;
+    }();
+    return tables;
+  }
+
 };
 
 
@@ -2,7 +2,12 @@
 
 #include "encoder.h"
 
-using namespace torch::indexing;
+torch::Tensor Encoder::encode(const GameState& game_state) const {
+  auto tensor = torch::empty(input_shape());
+  encode_into(game_state, tensor.data_ptr<float>());
+  return tensor;
+}
+
 
 /// Simple 11-plane encoder from book
 /// Stones encoded by liberty count from perspective of current player
@@ -12,33 +17,33 @@ using namespace torch::indexing;
 /// 8: 1 if white to move (current player gets komi)
 /// 9: 1 if black to move (opponent gets komi)
 /// 10: move would be illegal due to ko
-torch::Tensor SimpleEncoder::encode(const GameState& game_state) const {
-  auto board_tensor = torch::zeros({11, board_size, board_size});
+void SimpleEncoder::encode_into(const GameState& game_state, const std::vector<Point>& ko_points,
+                                float* buffer, const Dihedral& transform) const {
+  const int plane_size = board_size * board_size;
+  std::fill(buffer, buffer + num_planes * plane_size, 0.0f);
   auto next_player = game_state.next_player;
+  // Destination of each point within a plane:
+  const auto& point_map = transform.point_map(board_size);
+
+  auto komi_plane = buffer + (next_player == Player::white ? 8 : 9) * plane_size;
+  std::fill(komi_plane, komi_plane + plane_size, 1.0f);
+
+  // The board's liberty planes are from black's perspective.  When white is to
+  // move, swapping bit 2 exchanges the current player's and opponent's planes.
+  const auto& liberty_planes = game_state.board->get_liberty_planes();
+  assert(liberty_planes.size() == plane_size);
+  const int perspective = next_player == Player::white ? 4 : 0;
 
-  if (next_player == Player::white)
-    board_tensor.index_put_({8, Ellipsis}, 1.0);
-  else
-    board_tensor.index_put_({9, Ellipsis}, 1.0);
-  for (auto i=0; i<board_size; ++i) {
-    for (auto j=0; j<board_size; ++j) {
-      auto p = Point(i+1, j+1);
-      auto go_string = game_state.board->get_go_string(p);
-
-      if (! go_string) {
-        if (game_state.does_move_violate_ko(next_player, Move::play(p)))
-          board_tensor.index_put_({10, i, j}, 1.0);
-      }
-      else {
-        auto liberty_plane = std::min(4, go_string.value()->num_liberties()) - 1;
-        if (go_string.value()->color != next_player)
-          liberty_plane += 4;
-        board_tensor.index_put_({liberty_plane, i, j}, 1.0);
-      }
-    }
+  for (auto offset=0; offset<plane_size; ++offset) {
+    auto plane = liberty_planes[offset];
+    if (plane)
+      buffer[((plane - 1) ^ perspective) * plane_size + point_map[offset]] = 1.0;
+  }
+
+  for (auto point : ko_points) {
+    auto offset = (point.row - 1) * board_size + point.col - 1;
+    buffer[10 * plane_size + point_map[offset]] = 1.0;
   }
-  
-  return board_tensor;
 }
 
 Move SimpleEncoder::decode_move_index(int index) const {
@@ -49,13 +54,19 @@ Move SimpleEncoder::decode_move_index(int index) const {
   return Move::play(Point(row+1, col+1));
 }
 
+int SimpleEncoder::encode_move(Move move) const {
+  if (move.is_pass)
+    return board_size * board_size;
+  assert(move.is_play);
+  auto point = move.point.value();
+  return (point.row - 1) * board_size + point.col - 1;
+}
+
 
-torch::Tensor SimpleEncoder::untransform_policy(const torch::Tensor policy, const Dihedral dihedral) const {
-  assert(policy.dim() == 2);
-  auto board_moves = policy.index({Slice(), Slice(0, -1)});
-  assert(torch::numel(board_moves) == board_size * board_size);
-  board_moves = board_moves.reshape({1, board_size, board_size});
-  board_moves = dihedral.inverse(board_moves).reshape({1, board_size * board_size});
-  // Now add back the pass element to the end
-  return torch::cat({board_moves, policy.index({Slice(), Slice(-1, None)})}, 1);
+void SimpleEncoder::untransform_policy(const float* policy, const Dihedral& transform, float* output) const {
+  const auto& point_map = transform.point_map(board_size);
+  for (auto i=0; i<board_size * board_size; ++i)
+    output[i] = policy[point_map[i]];
+  // Pass is unaffected by the transformation.
+  output[board_size * board_size] = policy[board_size * board_size];
 }
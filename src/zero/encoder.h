@@ -1,6 +1,7 @@
 #ifndef ENCODER_H
 #define ENCODER_H
 
+#include <vector>
 #include <torch/torch.h>
 
 #include "../goboard.h"
@@ -9,10 +10,32 @@
 
 class Encoder {
  public:
-  virtual torch::Tensor encode(const GameState&) const = 0;
+  /// Write the features for a position into `buffer`, which must hold
+  /// input_size() floats laid out according to input_shape().  The board
+  /// features are permuted according to `transform`.  `ko_points` are the
+  /// position's ko_points(), for callers that have already computed them.
+  virtual void encode_into(const GameState&, const std::vector<Point>& ko_points,
+                           float* buffer, const Dihedral& transform) const = 0;
+  void encode_into(const GameState& game_state, float* buffer, const Dihedral& transform) const {
+    encode_into(game_state, game_state.ko_points(), buffer, transform);
+  }
+  void encode_into(const GameState& game_state, float* buffer) const {
+    encode_into(game_state, buffer, Dihedral(0, false));
+  }
+  /// Shape of a single encoded position: (planes, rows, cols).
+  virtual std::vector<int64_t> input_shape() const = 0;
+  int input_size() const {
+    auto shape = input_shape();
+    return shape[0] * shape[1] * shape[2];
+  }
+  /// Encode a position into a newly allocated tensor.
+  torch::Tensor encode(const GameState&) const;
   virtual Move decode_move_index(int index) const = 0;
+  virtual int encode_move(Move move) const = 0;
   virtual int num_moves() const = 0;
-  virtual torch::Tensor untransform_policy(const torch::Tensor policy, const Dihedral dihedral) const = 0;
+  /// Convert a policy for a position encoded with `transform` back to the
+  /// original orientation.  Both arrays hold num_moves() values.
+  virtual void untransform_policy(const float* policy, const Dihedral& transform, float* output) const = 0;
 };
 
 class SimpleEncoder : public Encoder {
@@ -21,13 +44,19 @@ class SimpleEncoder : public Encoder {
 
  public:
   SimpleEncoder(int board_size) : board_size(board_size) {}
-  
-  torch::Tensor encode(const GameState&) const;
+
+  using Encoder::encode_into;
+  void encode_into(const GameState&, const std::vector<Point>& ko_points,
+                   float* buffer, const Dihedral& transform) const;
+  std::vector<int64_t> input_shape() const {
+    return {num_planes, board_size, board_size};
+  }
   Move decode_move_index(int index) const;
+  int encode_move(Move move) const;
   int num_moves() const {
     return board_size * board_size + 1;
   }
-  torch::Tensor untransform_policy(const torch::Tensor policy, const Dihedral dihedral) const;
+  void untransform_policy(const float* policy, const Dihedral& transform, float* output) const;
 };
 
 
@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "evaluator.h"
+
+namespace {
+  /// FNV-1a hash of the input, used to check that a replay matches the
+  /// recording.
+  uint64_t hash_input(const float* input, size_t size) {
+    auto bytes = reinterpret_cast<const unsigned char*>(input);
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i=0; i<size * sizeof(float); ++i) {
+      hash ^= bytes[i];
+      hash *= 1099511628211ULL;
+    }
+    return hash;
+  }
+}
+
+
+void UniformEvaluator::evaluate(const float* input, int batch_size,
+                                float* priors, float* values) {
+  std::fill(priors, priors + batch_size * num_moves, 1.0f / num_moves);
+  std::fill(values, values + batch_size, 0.0f);
+}
+
+
+RecordingEvaluator::RecordingEvaluator(std::shared_ptr<Evaluator> evaluator,
+                                       int input_size, int num_moves,
+                                       const std::string& path) :
+  evaluator(evaluator), input_size(input_size), num_moves(num_moves),
+  fout(path, std::ios::out | std::ios::binary) {
+  if (! fout)
+    throw std::runtime_error("unable to open evaluation record: " + path);
+}
+
+
+void RecordingEvaluator::evaluate(const float* input, int batch_size,
+                                  float* priors, float* values) {
+  evaluator->evaluate(input, batch_size, priors, values);
+
+  int32_t batch = batch_size;
+  auto hash = hash_input(input, batch_size * input_size);
+  fout.write(reinterpret_cast<const char*>(&batch), sizeof(batch));
+  fout.write(reinterpret_cast<const char*>(&hash), sizeof(hash));
+  fout.write(reinterpret_cast<const char*>(priors), batch_size * num_moves * sizeof(float));
+  fout.write(reinterpret_cast<const char*>(values), batch_size * sizeof(float));
+}
+
+
+RecordingEvaluator::~RecordingEvaluator() {
+  fout.flush();
+}
+
+
+ReplayEvaluator::ReplayEvaluator(int input_size, int num_moves,
+                                 const std::string& path) :
+  input_size(input_size), num_moves(num_moves),
+  fin(path, std::ios::in | std::ios::binary) {
+  if (! fin)
+    throw std::runtime_error("unable to open evaluation record: " + path);
+}
+
+
+void ReplayEvaluator::evaluate(const float* input, int batch_size,
+                               float* priors, float* values) {
+  int32_t batch;
+  uint64_t hash;
+  fin.read(reinterpret_cast<char*>(&batch), sizeof(batch));
+  fin.read(reinterpret_cast<char*>(&hash), sizeof(hash));
+  if (! fin)
+    throw std::runtime_error("evaluation record exhausted");
+  if (batch != batch_size || hash != hash_input(input, batch_size * input_size))
+    throw std::runtime_error("evaluation doesn't match record");
+  fin.read(reinterpret_cast<char*>(priors), batch_size * num_moves * sizeof(float));
+  fin.read(reinterpret_cast<char*>(values), batch_size * sizeof(float));
+  if (! fin)
+    throw std::runtime_error("evaluation record truncated");
+}
@@ -0,0 +1,92 @@
+#ifndef EVALUATOR_H
+#define EVALUATOR_H
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+/// Batched position evaluation for the zero agent.
+///
+/// Positions are passed already encoded, as `batch_size` consecutive inputs of
+/// `input_size` floats each.  The evaluator writes `batch_size * num_moves`
+/// move priors, indexed by encoder move index, and `batch_size` values from the
+/// perspective of the player to move.
+class Evaluator {
+public:
+  virtual ~Evaluator() = default;
+
+  virtual void evaluate(const float* input, int batch_size,
+                        float* priors, float* values) = 0;
+
+  /// Called around each search, so that an evaluator shared between
+  /// concurrent searches knows which of them will make more requests.
+  virtual void begin_search() {}
+  virtual void end_search() {}
+};
+
+
+/// Marks a search on an evaluator for the lifetime of the scope.
+class SearchScope {
+  Evaluator& evaluator;
+
+public:
+  explicit SearchScope(Evaluator& evaluator) : evaluator(evaluator) {
+    evaluator.begin_search();
+  }
+  ~SearchScope() { evaluator.end_search(); }
+
+  SearchScope(const SearchScope&) = delete;
+  SearchScope& operator=(const SearchScope&) = delete;
+};
+
+
+/// Uniform priors and zero values, for testing and profiling the search
+/// without a network.
+class UniformEvaluator : public Evaluator {
+  int num_moves;
+
+public:
+  UniformEvaluator(int num_moves) : num_moves(num_moves) {}
+
+  void evaluate(const float* input, int batch_size, float* priors, float* values);
+};
+
+
+/// Passes evaluations through to another evaluator and records the outputs so
+/// that they can be played back with ReplayEvaluator.
+class RecordingEvaluator : public Evaluator {
+  std::shared_ptr<Evaluator> evaluator;
+  int input_size;
+  int num_moves;
+  std::ofstream fout;
+
+public:
+  RecordingEvaluator(std::shared_ptr<Evaluator> evaluator,
+                     int input_size, int num_moves,
+                     const std::string& path);
+  /// Flushes the recording.
+  ~RecordingEvaluator();
+
+  void evaluate(const float* input, int batch_size, float* priors, float* values);
+  void begin_search() { evaluator->begin_search(); }
+  void end_search() { evaluator->end_search(); }
+};
+
+
+/// Plays back outputs saved by RecordingEvaluator, in order.  The inputs are
+/// checked against the recording, so the search must be deterministic (e.g.,
+/// with a fixed random seed) and make the same evaluations as when recorded.
+class ReplayEvaluator : public Evaluator {
+  int input_size;
+  int num_moves;
+  std::ifstream fin;
+
+public:
+  ReplayEvaluator(int input_size, int num_moves, const std::string& path);
+
+  void evaluate(const float* input, int batch_size, float* priors, float* values);
+};
+
+#endif // EVALUATOR_H
@@ -82,8 +82,11 @@ void ExperienceCollector::serialize_binary(const std::string directory, const st
   auto visit_counts_tensor = torch::cat(visit_counts);
   auto rewards_tensor = torch::from_blob(rewards.data(),
                                          {static_cast<int64_t>(rewards.size())}).to(torch::kFloat32);
+  auto full_search_tensor = torch::from_blob(full_search.data(),
+                                             {static_cast<int64_t>(full_search.size())}).to(torch::kFloat32);
 
   serialize_tensor(states_tensor, directory, "states" + label);
   serialize_tensor(visit_counts_tensor, directory, "visit_counts" + label);
   serialize_tensor(rewards_tensor, directory, "rewards" + label);
+  serialize_tensor(full_search_tensor, directory, "full_search" + label);
 }
@@ -10,32 +10,48 @@ public:
   std::vector<torch::Tensor> states;
   std::vector<torch::Tensor> visit_counts;
   std::vector<float> rewards;
+  // 1 for positions whose visit counts come from a full search and can be used
+  // as policy targets, 0 for value-only positions.
+  std::vector<float> full_search;
 
 private:
   std::vector<torch::Tensor> current_episode_states;
   std::vector<torch::Tensor> current_episode_visit_counts;
+  std::vector<float> current_episode_full_search;
   
 public:
 
   void begin_episode() {
     current_episode_states.clear();
     current_episode_visit_counts.clear();
+    current_episode_full_search.clear();
   }
 
   void record_decision(torch::Tensor state, torch::Tensor visit_counts) {
     // Unsqueeze so that we get expected shape when concatenating
     current_episode_states.push_back(state.unsqueeze(0));
     current_episode_visit_counts.push_back(visit_counts.unsqueeze(0));
+    current_episode_full_search.push_back(1.0);
+  }
+
+  /// Record a position without a policy target, e.g., from a fast search
+  /// under playout cap randomization.  Only its reward is meaningful.
+  void record_position(torch::Tensor state, int num_moves) {
+    current_episode_states.push_back(state.unsqueeze(0));
+    current_episode_visit_counts.push_back(torch::zeros({1, num_moves}));
+    current_episode_full_search.push_back(0.0);
   }
 
   void complete_episode(float reward) {
     states.insert(states.end(), current_episode_states.begin(), current_episode_states.end());
     visit_counts.insert(visit_counts.end(), current_episode_visit_counts.begin(), current_episode_visit_counts.end());
     rewards.insert(rewards.end(), current_episode_states.size(), reward);
+    full_search.insert(full_search.end(), current_episode_full_search.begin(), current_episode_full_search.end());
 
     // Clear current episode containers.
     current_episode_states.clear();
     current_episode_visit_counts.clear();
+    current_episode_full_search.clear();
   }
 
   /// Append data from other.
@@ -46,6 +62,7 @@ public:
     states.insert(states.end(), other.states.begin(), other.states.end());
     visit_counts.insert(visit_counts.end(), other.visit_counts.begin(), other.visit_counts.end());
     rewards.insert(rewards.end(), other.rewards.begin(), other.rewards.end());
+    full_search.insert(full_search.end(), other.full_search.begin(), other.full_search.end());
   }
 
 
@@ -57,10 +74,12 @@ public:
     states.clear();
     visit_counts.clear();
     rewards.clear();
+    full_search.clear();
 
     // Should be redundant if complete_episode has been called...
     current_episode_states.clear();
     current_episode_visit_counts.clear();
+    current_episode_full_search.clear();
   }
 
 
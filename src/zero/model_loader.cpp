@@ -0,0 +1,89 @@
+#include <iostream>
+#include <stdexcept>
+
+#include "model_loader.h"
+#include "native_net.h"
+#include "torchscript_evaluator.h"
+#include "../utils.h"
+
+namespace {
+
+  /// Evaluate a batch of empty inputs.
+  void run_batch(Evaluator& evaluator, const Encoder& encoder, int batch_size) {
+    std::vector<float> input(batch_size * encoder.input_size(), 0.0f);
+    std::vector<float> priors(batch_size * encoder.num_moves());
+    std::vector<float> values(batch_size);
+    evaluator.evaluate(input.data(), batch_size, priors.data(), values.data());
+  }
+
+  double time_batches(Evaluator& evaluator, const Encoder& encoder, int batch_size, int repeats) {
+    auto timer = Timer();
+    for (int i=0; i<repeats; ++i)
+      run_batch(evaluator, encoder, batch_size);
+    return timer.elapsed();
+  }
+
+  std::shared_ptr<Evaluator> load_torchscript(const std::string& path,
+                                              const Encoder& encoder,
+                                              const ModelLoadOptions& options) {
+    torch::jit::script::Module model;
+    try {
+      model = torch::jit::load(path);
+      model.eval();
+      model = torch::jit::freeze(model);
+    }
+    catch (const c10::Error& e) {
+      throw std::runtime_error("error loading model: " + path);
+    }
+    if (! options.save_path.empty()) {
+      model.save(options.save_path);
+      std::cerr << "Saved frozen model: " << options.save_path << std::endl;
+    }
+    model = torch::jit::optimize_for_inference(model);
+
+    auto evaluator = std::make_shared<TorchScriptEvaluator>(model, encoder.input_shape());
+
+    // The profiling executor specializes the graph over the first few runs,
+    // so both memory formats are warmed up before they are timed.
+    const int probe_batch_size = options.warmup_batch_sizes.empty() ? 1 : options.warmup_batch_sizes.back();
+    double probe_times[2];
+    for (int channels_last=0; channels_last<2; ++channels_last) {
+      evaluator->set_channels_last(channels_last);
+      time_batches(*evaluator, encoder, probe_batch_size, 3);
+      probe_times[channels_last] = time_batches(*evaluator, encoder, probe_batch_size, 10);
+    }
+    bool channels_last = probe_times[1] < probe_times[0];
+    evaluator->set_channels_last(channels_last);
+    std::cerr << "Selected " << (channels_last ? "channels-last" : "contiguous") << " input ("
+              << 100 * probe_times[0] << " vs " << 100 * probe_times[1] << " ms per batch)" << std::endl;
+    return evaluator;
+  }
+
+}
+
+
+std::shared_ptr<Evaluator> load_evaluator(const std::string& path,
+                                          const Encoder& encoder,
+                                          const ModelLoadOptions& options) {
+  auto timer = Timer();
+  std::shared_ptr<Evaluator> evaluator;
+  if (is_native_network_file(path)) {
+    evaluator = std::make_shared<NativeEvaluator>(NativeNetWeights::load(path), options.quantized);
+  }
+  else {
+    if (options.quantized)
+      throw std::runtime_error("quantized inference requires a native network: " + path);
+    evaluator = load_torchscript(path, encoder, options);
+  }
+  auto load_time = timer.elapsed();
+
+  timer.reset();
+  for (auto batch_size : options.warmup_batch_sizes) {
+    // A second run catches specializations made after profiling the first.
+    for (int i=0; i<2; ++i)
+      run_batch(*evaluator, encoder, batch_size);
+  }
+  std::cerr << "Loaded " << path << (options.quantized ? " (int8)" : "") << " in " << load_time
+            << " s, warmup " << timer.elapsed() << " s" << std::endl;
+  return evaluator;
+}
@@ -0,0 +1,35 @@
+#ifndef MODEL_LOADER_H
+#define MODEL_LOADER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "encoder.h"
+#include "evaluator.h"
+
+struct ModelLoadOptions {
+  // Batch sizes evaluated before the model is returned, so that TorchScript
+  // profiling and optimization happen at load time instead of during the
+  // first searches.
+  std::vector<int> warmup_batch_sizes = {1};
+  // If not empty, the frozen TorchScript module is saved to this path.
+  // Loading the saved module skips freezing on later startups.
+  std::string save_path;
+  // Use int8 inference; only supported for calibrated native networks.
+  bool quantized = false;
+};
+
+/// Load a network file as an evaluator.  Native network files (see
+/// native_net.h) are evaluated directly.  TorchScript modules are frozen,
+/// which folds batch normalization into the preceding convolutions, and
+/// optimized for inference.  The faster of contiguous and channels-last input
+/// is then selected with a short timing probe.  Load and warmup times are
+/// reported on stderr, which keeps stdout free for GTP.
+///
+/// Throws std::runtime_error if the network can't be loaded.
+std::shared_ptr<Evaluator> load_evaluator(const std::string& path,
+                                          const Encoder& encoder,
+                                          const ModelLoadOptions& options = {});
+
+#endif // MODEL_LOADER_H
@@ -0,0 +1,577 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
+
+#include "native_net.h"
+
+
+namespace {
+
+  constexpr char MAGIC[8] = {'D', 'L', 'G', 'O', 'N', 'E', 'T', '1'};
+  // Largest dimensions accepted from a file header.
+  constexpr int MAX_CHANNELS = 1024;
+  constexpr int MAX_GRID_SIZE = 25;
+  constexpr int MAX_LAYERS = 256;
+  constexpr int MAX_HIDDEN = 4096;
+
+  int32_t read_int(std::istream& in) {
+    int32_t value;
+    in.read(reinterpret_cast<char*>(&value), sizeof(value));
+    return value;
+  }
+
+  void write_int(std::ostream& out, int32_t value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  void read_floats(std::istream& in, std::vector<float>& values, size_t size) {
+    values.resize(size);
+    in.read(reinterpret_cast<char*>(values.data()), size * sizeof(float));
+  }
+
+  void write_floats(std::ostream& out, const std::vector<float>& values) {
+    out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(float));
+  }
+
+  ConvLayer read_conv(std::istream& in, int in_channels, int out_channels, int kernel_size) {
+    ConvLayer layer;
+    layer.in_channels = in_channels;
+    layer.out_channels = out_channels;
+    layer.kernel_size = kernel_size;
+    read_floats(in, layer.weights, out_channels * in_channels * kernel_size * kernel_size);
+    read_floats(in, layer.bias, out_channels);
+    return layer;
+  }
+
+  DenseLayer read_dense(std::istream& in, int in_features, int out_features) {
+    DenseLayer layer;
+    layer.in_features = in_features;
+    layer.out_features = out_features;
+    read_floats(in, layer.weights, out_features * in_features);
+    read_floats(in, layer.bias, out_features);
+    return layer;
+  }
+
+
+  /// 1x1 convolution with ReLU from padded channels-last activations to a
+  /// flattened (channel, row, col) feature vector, as consumed by the linear
+  /// layers.
+  void conv1x1_relu(const float* in, int grid_size, const ConvLayer& layer, float* out) {
+    const int padded = grid_size + 2;
+    const int c_in = layer.in_channels;
+    for (int y=0; y<grid_size; ++y) {
+      for (int x=0; x<grid_size; ++x) {
+        const float* pixel = in + ((y + 1) * padded + x + 1) * c_in;
+        for (int o=0; o<layer.out_channels; ++o) {
+          const float* w = layer.weights.data() + o * c_in;
+          float sum = layer.bias[o];
+          for (int i=0; i<c_in; ++i)
+            sum += w[i] * pixel[i];
+          out[(o * grid_size + y) * grid_size + x] = std::max(sum, 0.0f);
+        }
+      }
+    }
+  }
+
+  void dense(const float* in, const DenseLayer& layer, float* out) {
+    for (int o=0; o<layer.out_features; ++o) {
+      const float* w = layer.weights.data() + o * layer.in_features;
+      float sum = 0.0;
+      for (int i=0; i<layer.in_features; ++i)
+        sum += w[i] * in[i];
+      out[o] = sum + layer.bias[o];
+    }
+  }
+
+
+  /// 3x3 convolution with ReLU.  `in` and `out` are padded channels-last
+  /// activations; weights are packed as (ky, kx, in, out).  The border of
+  /// `out` isn't written.
+  void conv3x3_relu_scalar(const float* in, int c_in, const float* w, const float* bias,
+                           float* out, int c_out, int grid_size) {
+    const int padded = grid_size + 2;
+    for (int y=0; y<grid_size; ++y) {
+      for (int x=0; x<grid_size; ++x) {
+        float* dest = out + ((y + 1) * padded + x + 1) * c_out;
+        std::copy_n(bias, c_out, dest);
+        for (int ky=0; ky<3; ++ky) {
+          for (int kx=0; kx<3; ++kx) {
+            const float* src = in + ((y + ky) * padded + x + kx) * c_in;
+            const float* wt = w + (ky * 3 + kx) * c_in * c_out;
+            for (int i=0; i<c_in; ++i) {
+              for (int o=0; o<c_out; ++o)
+                dest[o] += src[i] * wt[i * c_out + o];
+            }
+          }
+        }
+        for (int o=0; o<c_out; ++o)
+          dest[o] = std::max(dest[o], 0.0f);
+      }
+    }
+  }
+
+  /// Quantize padded channels-last activations to unsigned 7-bit values, with
+  /// the channel stride rounded up to padded_channels.  Limiting activations
+  /// to 7 bits means pairs of products can't saturate 16-bit intermediates in
+  /// the vector kernel.
+  void quantize_activations(const float* in, int channels, int num_points, float input_scale,
+                            uint8_t* out, int padded_channels) {
+    const float inv_scale = 1.0f / input_scale;
+    for (int p=0; p<num_points; ++p) {
+      for (int c=0; c<channels; ++c) {
+        auto q = static_cast<int>(in[p * channels + c] * inv_scale + 0.5f);
+        out[p * padded_channels + c] = std::clamp(q, 0, 127);
+      }
+      for (int c=channels; c<padded_channels; ++c)
+        out[p * padded_channels + c] = 0;
+    }
+  }
+
+  /// Quantized 3x3 convolution with ReLU and float output.  Apart from the
+  /// types, arguments are as for conv3x3_relu, with weights packed as
+  /// described for QuantizedConv.
+  void conv3x3_relu_int8_scalar(const uint8_t* in, int c_in, const int8_t* w,
+                                const float* scales, const float* bias,
+                                float* out, int c_out, int grid_size) {
+    const int padded = grid_size + 2;
+    std::vector<int32_t> acc(c_out);
+    for (int y=0; y<grid_size; ++y) {
+      for (int x=0; x<grid_size; ++x) {
+        std::fill(acc.begin(), acc.end(), 0);
+        for (int k=0; k<9; ++k) {
+          const uint8_t* src = in + ((y + k / 3) * padded + x + k % 3) * c_in;
+          const int8_t* wt = w + k * c_in * c_out;
+          for (int g=0; g<c_in/4; ++g) {
+            for (int o=0; o<c_out; ++o) {
+              for (int j=0; j<4; ++j)
+                acc[o] += src[g * 4 + j] * wt[(g * c_out + o) * 4 + j];
+            }
+          }
+        }
+        float* dest = out + ((y + 1) * padded + x + 1) * c_out;
+        for (int o=0; o<c_out; ++o)
+          dest[o] = std::max(acc[o] * scales[o] + bias[o], 0.0f);
+      }
+    }
+  }
+
+#if defined(__AVX2__) && defined(__FMA__)
+
+  /// Compute NV*8 output channels for P horizontally adjacent pixels.  The
+  /// accumulators stay in registers for the whole 3x3xC_in reduction, and each
+  /// weight vector load is reused across the P pixels.
+  template <int NV, int P>
+  inline void conv3x3_block(const float* in, int c_in, int row_stride,
+                            const float* w, const float* bias, int c_out,
+                            float* out) {
+    __m256 acc[P][NV];
+    for (int v=0; v<NV; ++v) {
+      auto b = _mm256_loadu_ps(bias + v * 8);
+      for (int p=0; p<P; ++p)
+        acc[p][v] = b;
+    }
+    for (int ky=0; ky<3; ++ky) {
+      for (int kx=0; kx<3; ++kx) {
+        const float* src = in + ky * row_stride + kx * c_in;
+        const float* wt = w + (ky * 3 + kx) * c_in * c_out;
+        for (int i=0; i<c_in; ++i) {
+          __m256 wv[NV];
+          for (int v=0; v<NV; ++v)
+            wv[v] = _mm256_loadu_ps(wt + i * c_out + v * 8);
+          for (int p=0; p<P; ++p) {
+            auto x = _mm256_broadcast_ss(src + p * c_in + i);
+            for (int v=0; v<NV; ++v)
+              acc[p][v] = _mm256_fmadd_ps(x, wv[v], acc[p][v]);
+          }
+        }
+      }
+    }
+    const auto zero = _mm256_setzero_ps();
+    for (int p=0; p<P; ++p) {
+      for (int v=0; v<NV; ++v)
+        _mm256_storeu_ps(out + p * c_out + v * 8, _mm256_max_ps(acc[p][v], zero));
+    }
+  }
+
+  template <int NV>
+  void conv3x3_relu_channels(const float* in, int c_in, const float* w, const float* bias,
+                             float* out, int c_out, int grid_size) {
+    // Three pixels divides 9x9 rows evenly, leaving no single-pixel tail.
+    constexpr int P = 3;
+    const int padded = grid_size + 2;
+    const int row_stride = padded * c_in;
+    for (int y=0; y<grid_size; ++y) {
+      int x = 0;
+      for (; x + P <= grid_size; x += P) {
+        conv3x3_block<NV, P>(in + (y * padded + x) * c_in, c_in, row_stride, w, bias, c_out,
+                             out + ((y + 1) * padded + x + 1) * c_out);
+      }
+      for (; x < grid_size; ++x) {
+        conv3x3_block<NV, 1>(in + (y * padded + x) * c_in, c_in, row_stride, w, bias, c_out,
+                             out + ((y + 1) * padded + x + 1) * c_out);
+      }
+    }
+  }
+
+  void conv3x3_relu(const float* in, int c_in, const float* w, const float* bias,
+                    float* out, int c_out, int grid_size) {
+    if (c_out % 8 != 0) {
+      conv3x3_relu_scalar(in, c_in, w, bias, out, c_out, grid_size);
+      return;
+    }
+    // Blocks of 32 output channels, then 8.  Offsetting the weights, bias and
+    // output selects the block; strides stay c_out.
+    int o = 0;
+    for (; o + 32 <= c_out; o += 32)
+      conv3x3_relu_channels<4>(in, c_in, w + o, bias + o, out + o, c_out, grid_size);
+    for (; o < c_out; o += 8)
+      conv3x3_relu_channels<1>(in, c_in, w + o, bias + o, out + o, c_out, grid_size);
+  }
+
+  /// Quantized counterpart of conv3x3_block.  Each group of 4 input channels
+  /// is broadcast as a 32-bit value and multiplied with the weights for 8
+  /// output channels using unsigned-by-signed byte products, which are summed
+  /// into 32-bit accumulators.
+  template <int NV, int P>
+  inline void conv3x3_block_int8(const uint8_t* in, int c_in, int row_stride,
+                                 const int8_t* w, const float* scales, const float* bias,
+                                 int c_out, float* out) {
+    const auto ones = _mm256_set1_epi16(1);
+    __m256i acc[P][NV];
+    for (int p=0; p<P; ++p)
+      for (int v=0; v<NV; ++v)
+        acc[p][v] = _mm256_setzero_si256();
+    for (int ky=0; ky<3; ++ky) {
+      for (int kx=0; kx<3; ++kx) {
+        const uint8_t* src = in + ky * row_stride + kx * c_in;
+        const int8_t* wt = w + (ky * 3 + kx) * c_in * c_out;
+        for (int g=0; g<c_in/4; ++g) {
+          __m256i wv[NV];
+          for (int v=0; v<NV; ++v)
+            wv[v] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(wt + (g * c_out + v * 8) * 4));
+          for (int p=0; p<P; ++p) {
+            int32_t group;
+            std::memcpy(&group, src + p * c_in + g * 4, sizeof(group));
+            auto x = _mm256_set1_epi32(group);
+            for (int v=0; v<NV; ++v) {
+              auto pairs = _mm256_maddubs_epi16(x, wv[v]);
+              acc[p][v] = _mm256_add_epi32(acc[p][v], _mm256_madd_epi16(pairs, ones));
+            }
+          }
+        }
+      }
+    }
+    const auto zero = _mm256_setzero_ps();
+    for (int v=0; v<NV; ++v) {
+      auto scale = _mm256_loadu_ps(scales + v * 8);
+      auto b = _mm256_loadu_ps(bias + v * 8);
+      for (int p=0; p<P; ++p) {
+        auto result = _mm256_fmadd_ps(_mm256_cvtepi32_ps(acc[p][v]), scale, b);
+        _mm256_storeu_ps(out + p * c_out + v * 8, _mm256_max_ps(result, zero));
+      }
+    }
+  }
+
+  template <int NV>
+  void conv3x3_relu_int8_channels(const uint8_t* in, int c_in, const int8_t* w,
+                                  const float* scales, const float* bias,
+                                  float* out, int c_out, int grid_size) {
+    constexpr int P = 3;
+    const int padded = grid_size + 2;
+    const int row_stride = padded * c_in;
+    for (int y=0; y<grid_size; ++y) {
+      int x = 0;
+      for (; x + P <= grid_size; x += P) {
+        conv3x3_block_int8<NV, P>(in + (y * padded + x) * c_in, c_in, row_stride, w, scales, bias,
+                                  c_out, out + ((y + 1) * padded + x + 1) * c_out);
+      }
+      for (; x < grid_size; ++x) {
+        conv3x3_block_int8<NV, 1>(in + (y * padded + x) * c_in, c_in, row_stride, w, scales, bias,
+                                  c_out, out + ((y + 1) * padded + x + 1) * c_out);
+      }
+    }
+  }
+
+  void conv3x3_relu_int8(const uint8_t* in, int c_in, const int8_t* w,
+                         const float* scales, const float* bias,
+                         float* out, int c_out, int grid_size) {
+    if (c_out % 8 != 0) {
+      conv3x3_relu_int8_scalar(in, c_in, w, scales, bias, out, c_out, grid_size);
+      return;
+    }
+    // Weights interleave 4 input channels per output channel, so a block of
+    // output channels starts at 4 * o.
+    int o = 0;
+    for (; o + 32 <= c_out; o += 32)
+      conv3x3_relu_int8_channels<4>(in, c_in, w + 4 * o, scales + o, bias + o, out + o,
+                                    c_out, grid_size);
+    for (; o < c_out; o += 8)
+      conv3x3_relu_int8_channels<1>(in, c_in, w + 4 * o, scales + o, bias + o, out + o,
+                                    c_out, grid_size);
+  }
+
+#else
+
+  void conv3x3_relu(const float* in, int c_in, const float* w, const float* bias,
+                    float* out, int c_out, int grid_size) {
+    conv3x3_relu_scalar(in, c_in, w, bias, out, c_out, grid_size);
+  }
+
+  void conv3x3_relu_int8(const uint8_t* in, int c_in, const int8_t* w,
+                         const float* scales, const float* bias,
+                         float* out, int c_out, int grid_size) {
+    conv3x3_relu_int8_scalar(in, c_in, w, scales, bias, out, c_out, grid_size);
+  }
+
+#endif
+
+}
+
+
+NativeNetWeights NativeNetWeights::load(const std::string& path) {
+  std::ifstream fin(path, std::ios::in | std::ios::binary);
+  char magic[sizeof(MAGIC)];
+  fin.read(magic, sizeof(magic));
+  if (! fin || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0)
+    throw std::runtime_error("not a native network file: " + path);
+
+  NativeNetWeights weights;
+  weights.in_channels = read_int(fin);
+  weights.grid_size = read_int(fin);
+  auto num_layers = read_int(fin);
+  auto num_filters = read_int(fin);
+  auto policy_channels = read_int(fin);
+  auto policy_size = read_int(fin);
+  auto value_channels = read_int(fin);
+  auto value_hidden = read_int(fin);
+  if (! fin)
+    throw std::runtime_error("truncated native network file: " + path);
+
+  // Bound the dimensions before allocating, so that a corrupt header can't
+  // request huge layers.
+  auto check = [&](int value, int max_value) {
+    if (value < 1 || value > max_value)
+      throw std::runtime_error("invalid native network file: " + path);
+  };
+  check(weights.in_channels, MAX_CHANNELS);
+  check(weights.grid_size, MAX_GRID_SIZE);
+  const int grid_points = weights.grid_size * weights.grid_size;
+  check(num_layers, MAX_LAYERS);
+  check(num_filters, MAX_CHANNELS);
+  check(policy_channels, MAX_CHANNELS);
+  check(policy_size, grid_points + 1);
+  check(value_channels, MAX_CHANNELS);
+  check(value_hidden, MAX_HIDDEN);
+
+  auto check_stream = [&]() {
+    if (! fin)
+      throw std::runtime_error("truncated native network file: " + path);
+  };
+  for (int i=0; i<num_layers; ++i) {
+    weights.tower.push_back(read_conv(fin, i == 0 ? weights.in_channels : num_filters,
+                                      num_filters, 3));
+    check_stream();
+  }
+  weights.policy_conv = read_conv(fin, num_filters, policy_channels, 1);
+  check_stream();
+  weights.policy_dense = read_dense(fin, policy_channels * grid_points, policy_size);
+  check_stream();
+  weights.value_conv = read_conv(fin, num_filters, value_channels, 1);
+  check_stream();
+  weights.value_hidden = read_dense(fin, value_channels * grid_points, value_hidden);
+  check_stream();
+  weights.value_output = read_dense(fin, value_hidden, 1);
+  check_stream();
+
+  // Activation ranges are only present in calibrated files, with one per
+  // tower layer.
+  auto num_ranges = read_int(fin);
+  if (fin) {
+    if (num_ranges != num_layers)
+      throw std::runtime_error("invalid native network file: " + path);
+    read_floats(fin, weights.activation_ranges, num_ranges);
+    if (! fin)
+      throw std::runtime_error("truncated native network file: " + path);
+  }
+  return weights;
+}
+
+
+void NativeNetWeights::save(const std::string& path) const {
+  std::ofstream fout(path, std::ios::out | std::ios::binary);
+  fout.write(MAGIC, sizeof(MAGIC));
+  write_int(fout, in_channels);
+  write_int(fout, grid_size);
+  write_int(fout, tower.size());
+  write_int(fout, num_filters());
+  write_int(fout, policy_conv.out_channels);
+  write_int(fout, policy_size());
+  write_int(fout, value_conv.out_channels);
+  write_int(fout, value_hidden.out_features);
+
+  for (const auto& conv : tower) {
+    write_floats(fout, conv.weights);
+    write_floats(fout, conv.bias);
+  }
+  write_floats(fout, policy_conv.weights);
+  write_floats(fout, policy_conv.bias);
+  write_floats(fout, policy_dense.weights);
+  write_floats(fout, policy_dense.bias);
+  write_floats(fout, value_conv.weights);
+  write_floats(fout, value_conv.bias);
+  write_floats(fout, value_hidden.weights);
+  write_floats(fout, value_hidden.bias);
+  write_floats(fout, value_output.weights);
+  write_floats(fout, value_output.bias);
+  if (! activation_ranges.empty()) {
+    write_int(fout, activation_ranges.size());
+    write_floats(fout, activation_ranges);
+  }
+}
+
+
+bool is_native_network_file(const std::string& path) {
+  std::ifstream fin(path, std::ios::in | std::ios::binary);
+  char magic[sizeof(MAGIC)];
+  fin.read(magic, sizeof(magic));
+  return fin && std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+
+NativeNet::NativeNet(NativeNetWeights weights, bool quantized) :
+  weights(std::move(weights)), quantized(quantized) {
+  const auto& w = this->weights;
+  assert(! w.tower.empty());
+
+  for (const auto& conv : w.tower) {
+    assert(conv.kernel_size == 3);
+    std::vector<float> packed(conv.weights.size());
+    for (int o=0; o<conv.out_channels; ++o)
+      for (int i=0; i<conv.in_channels; ++i)
+        for (int k=0; k<9; ++k)
+          packed[(k * conv.in_channels + i) * conv.out_channels + o] =
+            conv.weights[(o * conv.in_channels + i) * 9 + k];
+    packed_tower.push_back(std::move(packed));
+  }
+
+  // Separate buffers for each channel count, so that the zero borders are
+  // never overwritten by data in a different layout.
+  const int padded_points = (w.grid_size + 2) * (w.grid_size + 2);
+  input_activations.assign(padded_points * w.in_channels, 0.0f);
+  for (auto& buffer : activations)
+    buffer.assign(padded_points * w.num_filters(), 0.0f);
+  policy_features.resize(w.policy_dense.in_features);
+  value_features.resize(w.value_hidden.in_features);
+  value_hidden.resize(w.value_hidden.out_features);
+
+  if (quantized)
+    quantize_tower();
+}
+
+
+void NativeNet::quantize_tower() {
+  if (weights.activation_ranges.size() != weights.tower.size())
+    throw std::runtime_error("network has no activation ranges for quantization");
+
+  int max_channels = 0;
+  for (size_t layer=0; layer<weights.tower.size(); ++layer) {
+    const auto& conv = weights.tower[layer];
+    QuantizedConv q;
+    q.in_channels = (conv.in_channels + 3) / 4 * 4;
+    q.out_channels = conv.out_channels;
+    q.input_scale = std::max(weights.activation_ranges[layer], 1e-6f) / 127;
+    q.weights.assign(9 * q.in_channels * q.out_channels, 0);
+    q.output_scales.resize(q.out_channels);
+
+    const int kernel_size = conv.in_channels * 9;
+    for (int o=0; o<conv.out_channels; ++o) {
+      const float* w = conv.weights.data() + o * kernel_size;
+      float max_weight = 0.0;
+      for (int i=0; i<kernel_size; ++i)
+        max_weight = std::max(max_weight, std::abs(w[i]));
+      auto weight_scale = std::max(max_weight, 1e-12f) / 127;
+      q.output_scales[o] = q.input_scale * weight_scale;
+      for (int i=0; i<conv.in_channels; ++i) {
+        for (int k=0; k<9; ++k) {
+          auto value = static_cast<int>(std::lround(w[i * 9 + k] / weight_scale));
+          q.weights[((k * (q.in_channels / 4) + i / 4) * q.out_channels + o) * 4 + i % 4] =
+            std::clamp(value, -127, 127);
+        }
+      }
+    }
+    max_channels = std::max(max_channels, q.in_channels);
+    quantized_tower.push_back(std::move(q));
+  }
+
+  const int padded_points = (weights.grid_size + 2) * (weights.grid_size + 2);
+  quantized_input.assign(padded_points * max_channels, 0);
+}
+
+
+void NativeNet::forward(const float* input, int batch_size, float* priors, float* values) {
+  for (int b=0; b<batch_size; ++b)
+    forward_one(input + b * input_size(), priors + b * policy_size(), values + b);
+}
+
+
+void NativeNet::forward_one(const float* input, float* priors, float* value) {
+  const int grid_size = weights.grid_size;
+  const int padded = grid_size + 2;
+  const int grid_points = grid_size * grid_size;
+
+  // Planar input to padded channels-last.
+  const int c_in = weights.in_channels;
+  float* in = input_activations.data();
+  for (int c=0; c<c_in; ++c)
+    for (int y=0; y<grid_size; ++y)
+      for (int x=0; x<grid_size; ++x)
+        in[((y + 1) * padded + x + 1) * c_in + c] = input[c * grid_points + y * grid_size + x];
+
+  for (size_t layer=0; layer<weights.tower.size(); ++layer) {
+    const auto& conv = weights.tower[layer];
+    float* out = activations[layer % 2].data();
+    if (quantized) {
+      // The whole padded buffer is requantized, which also clears the border
+      // left by a layer with a different channel count.
+      const auto& q = quantized_tower[layer];
+      quantize_activations(in, conv.in_channels, padded * padded, q.input_scale,
+                           quantized_input.data(), q.in_channels);
+      conv3x3_relu_int8(quantized_input.data(), q.in_channels, q.weights.data(),
+                        q.output_scales.data(), conv.bias.data(), out, conv.out_channels, grid_size);
+    }
+    else {
+      conv3x3_relu(in, conv.in_channels, packed_tower[layer].data(), conv.bias.data(),
+                   out, conv.out_channels, grid_size);
+    }
+    in = out;
+  }
+
+  // Policy head.
+  conv1x1_relu(in, grid_size, weights.policy_conv, policy_features.data());
+  dense(policy_features.data(), weights.policy_dense, priors);
+  const int policy_size = this->policy_size();
+  auto max_logit = *std::max_element(priors, priors + policy_size);
+  float total = 0.0;
+  for (int i=0; i<policy_size; ++i) {
+    priors[i] = std::exp(priors[i] - max_logit);
+    total += priors[i];
+  }
+  for (int i=0; i<policy_size; ++i)
+    priors[i] /= total;
+
+  // Value head.
+  conv1x1_relu(in, grid_size, weights.value_conv, value_features.data());
+  dense(value_features.data(), weights.value_hidden, value_hidden.data());
+  for (auto& h : value_hidden)
+    h = std::max(h, 0.0f);
+  dense(value_hidden.data(), weights.value_output, value);
+  *value = std::tanh(*value);
+}
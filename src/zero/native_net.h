@@ -0,0 +1,131 @@
+#ifndef NATIVE_NET_H
+#define NATIVE_NET_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "evaluator.h"
+
+/// Dependency-free inference for the conv_4x64 family of networks in
+/// nn/nine: a tower of 3x3 convolutions with ReLU, followed by the policy head
+/// (1x1 convolution, linear, softmax) and value head (1x1 convolution, two
+/// linear layers, tanh).  Batch normalization is folded into the preceding
+/// convolution by the exporter, nn/nine/export_native.py.
+///
+/// The tower can optionally run with int8 weights and 7-bit unsigned
+/// activations.  This requires activation ranges measured on experience data,
+/// which the exporter writes when given --calibration-data.
+
+struct ConvLayer {
+  int in_channels = 0;
+  int out_channels = 0;
+  int kernel_size = 0;
+  // Layout matches torch: (out, in, kernel, kernel).
+  std::vector<float> weights;
+  std::vector<float> bias;
+};
+
+struct DenseLayer {
+  int in_features = 0;
+  int out_features = 0;
+  // Layout matches torch: (out, in).
+  std::vector<float> weights;
+  std::vector<float> bias;
+};
+
+struct NativeNetWeights {
+  int in_channels = 0;
+  int grid_size = 0;
+  std::vector<ConvLayer> tower;
+  ConvLayer policy_conv;
+  DenseLayer policy_dense;
+  ConvLayer value_conv;
+  DenseLayer value_hidden;
+  DenseLayer value_output;
+  // Calibrated upper bound of the input activations to each tower layer, or
+  // empty if the network hasn't been calibrated.
+  std::vector<float> activation_ranges;
+
+  int num_filters() const { return tower.back().out_channels; }
+  int policy_size() const { return policy_dense.out_features; }
+
+  /// Load weights written by nn/nine/export_native.py.  Throws
+  /// std::runtime_error if the file is truncated or its dimensions are out
+  /// of range.
+  static NativeNetWeights load(const std::string& path);
+  void save(const std::string& path) const;
+};
+
+/// True if the file starts with the native weights header.
+bool is_native_network_file(const std::string& path);
+
+
+/// Tower layer quantized with a symmetric scale per output channel.
+struct QuantizedConv {
+  // Input channels rounded up to a multiple of 4.
+  int in_channels = 0;
+  int out_channels = 0;
+  // Packed as (ky, kx, in / 4, out, 4), so that each group of 4 input
+  // channels for 8 output channels fills a 256-bit vector.
+  std::vector<int8_t> weights;
+  // Input activations are quantized as round(x / input_scale).
+  float input_scale = 1.0;
+  // Converts accumulated products back to floats: input scale times the
+  // output channel's weight scale.
+  std::vector<float> output_scales;
+};
+
+
+class NativeNet {
+  NativeNetWeights weights;
+  // Tower weights repacked as (ky, kx, in, out) so that output channels are
+  // contiguous for the vector kernels.
+  std::vector<std::vector<float>> packed_tower;
+
+  bool quantized;
+  std::vector<QuantizedConv> quantized_tower;
+  // Quantized input to the current tower layer, in the same padded
+  // channels-last layout as the float activations.
+  std::vector<uint8_t> quantized_input;
+
+  // Activations in channels-last layout with a zero border of one point, so
+  // that 3x3 convolutions need no bounds checks.
+  std::vector<float> input_activations;
+  std::vector<float> activations[2];
+  std::vector<float> policy_features;
+  std::vector<float> value_features;
+  std::vector<float> value_hidden;
+
+public:
+  /// Throws std::runtime_error if quantized is requested for a network without
+  /// activation ranges.
+  explicit NativeNet(NativeNetWeights weights, bool quantized = false);
+
+  int input_size() const {
+    return weights.in_channels * weights.grid_size * weights.grid_size;
+  }
+  int policy_size() const { return weights.policy_size(); }
+
+  /// Input is (batch, channels, rows, cols), as produced by the encoder.
+  void forward(const float* input, int batch_size, float* priors, float* values);
+
+private:
+  void forward_one(const float* input, float* priors, float* value);
+  void quantize_tower();
+};
+
+
+class NativeEvaluator : public Evaluator {
+  NativeNet net;
+
+public:
+  explicit NativeEvaluator(NativeNetWeights weights, bool quantized = false) :
+    net(std::move(weights), quantized) {}
+
+  void evaluate(const float* input, int batch_size, float* priors, float* values) {
+    net.forward(input, batch_size, priors, values);
+  }
+};
+
+#endif // NATIVE_NET_H
@@ -0,0 +1,47 @@
+#include <algorithm>
+#include <vector>
+
+#include "resignation.h"
+#include "../myrand.h"
+
+
+std::optional<float> ResignationManager::begin_game() {
+  std::bernoulli_distribution dist(playthrough_fraction);
+  playthrough = dist(rng);
+  if (playthrough)
+    return std::nullopt;
+  return threshold;
+}
+
+
+void ResignationManager::complete_game(float winner_min_value) {
+  // Games with resignation enabled say nothing about false positives, since
+  // a resigning player is recorded as the loser.
+  if (! playthrough)
+    return;
+
+  ++num_playthrough_games;
+  if (winner_min_value < threshold)
+    ++num_false_positives;
+
+  winner_min_values.push_back(winner_min_value);
+  if (winner_min_values.size() > static_cast<size_t>(window))
+    winner_min_values.pop_front();
+  tune();
+}
+
+
+void ResignationManager::tune() {
+  if (winner_min_values.size() < MIN_SAMPLES)
+    return;
+
+  // Set the threshold at the target quantile of the winners' minimum values,
+  // so that the target fraction of winners would have resigned.
+  std::vector<float> values(winner_min_values.begin(), winner_min_values.end());
+  std::sort(values.begin(), values.end());
+  auto index = static_cast<size_t>(target_false_positive_rate * values.size());
+  if (index >= values.size())
+    index = values.size() - 1;
+  // Never resign a position that the search considers even or better.
+  threshold = std::clamp(values[index], -1.0f, 0.0f);
+}
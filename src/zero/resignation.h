@@ -0,0 +1,65 @@
+#ifndef RESIGNATION_H
+#define RESIGNATION_H
+
+#include <deque>
+#include <optional>
+
+/// Resignation threshold for self-play, calibrated against a false positive
+/// rate.
+///
+/// A fraction of games are played to completion with resignation disabled.
+/// In those games, a false positive is a winner whose root value dropped below
+/// the threshold at some point, i.e., a player that would have resigned a won
+/// game.  The threshold is tuned so that the false positive rate over recent
+/// play-through games matches the target rate.
+class ResignationManager {
+  float threshold;
+  float playthrough_fraction;
+  float target_false_positive_rate;
+  // Number of recent play-through games used to tune the threshold.
+  int window;
+
+  // Minimum root value reached by the winner of recent play-through games.
+  std::deque<float> winner_min_values;
+  bool playthrough = false;
+
+  int num_playthrough_games = 0;
+  int num_false_positives = 0;
+
+  // Don't tune until this many play-through games have been observed.
+  constexpr static int MIN_SAMPLES = 10;
+
+public:
+  ResignationManager(float initial_threshold,
+                     float playthrough_fraction = 0.1,
+                     float target_false_positive_rate = 0.05,
+                     int window = 200) :
+    threshold(initial_threshold),
+    playthrough_fraction(playthrough_fraction),
+    target_false_positive_rate(target_false_positive_rate),
+    window(window) {}
+
+  /// Start a new game.  Returns the threshold to use, or nullopt if the game
+  /// should be played through without resignation.
+  std::optional<float> begin_game();
+
+  /// Complete the current game, given the minimum root value reached by the
+  /// winner during the game.
+  void complete_game(float winner_min_value);
+
+  float get_threshold() const { return threshold; }
+  int get_num_playthrough_games() const { return num_playthrough_games; }
+
+  /// Fraction of play-through games in which the winner would have resigned
+  /// at the threshold in effect at the time.
+  float false_positive_rate() const {
+    if (num_playthrough_games == 0)
+      return 0.0;
+    return static_cast<float>(num_false_positives) / num_playthrough_games;
+  }
+
+private:
+  void tune();
+};
+
+#endif // RESIGNATION_H
@@ -0,0 +1,23 @@
+#include <algorithm>
+
+#include "torchscript_evaluator.h"
+
+
+void TorchScriptEvaluator::evaluate(const float* input, int batch_size,
+                                    float* priors, float* values) {
+  c10::InferenceMode guard;
+
+  auto shape = input_shape;
+  shape.insert(shape.begin(), batch_size);
+  // The model doesn't modify its input, so wrap the buffer without copying.
+  auto input_tensor = torch::from_blob(const_cast<float*>(input), shape);
+  if (channels_last)
+    input_tensor = input_tensor.contiguous(c10::MemoryFormat::ChannelsLast);
+
+  std::vector<torch::jit::IValue> inputs({input_tensor});
+  auto output = model.forward(inputs);
+  auto priors_tensor = output.toTuple()->elements()[0].toTensor().contiguous(); // Shape: (batch, num_moves)
+  auto values_tensor = output.toTuple()->elements()[1].toTensor().contiguous(); // Shape: (batch, 1)
+  std::copy_n(priors_tensor.data_ptr<float>(), priors_tensor.numel(), priors);
+  std::copy_n(values_tensor.data_ptr<float>(), values_tensor.numel(), values);
+}
@@ -0,0 +1,31 @@
+#ifndef TORCHSCRIPT_EVALUATOR_H
+#define TORCHSCRIPT_EVALUATOR_H
+
+#include <cstdint>
+#include <vector>
+#include <torch/script.h>
+
+#include "evaluator.h"
+
+/// Evaluates positions with a TorchScript model that returns a (priors, value)
+/// tuple.
+class TorchScriptEvaluator : public Evaluator {
+  torch::jit::script::Module model;
+  std::vector<int64_t> input_shape;
+  // If true, the input is converted to channels-last memory format, which can
+  // be faster for optimized convolutions.
+  bool channels_last;
+
+public:
+  /// input_shape is the shape of a single encoded position.
+  TorchScriptEvaluator(torch::jit::script::Module model,
+                       std::vector<int64_t> input_shape,
+                       bool channels_last = false) :
+    model(model), input_shape(input_shape), channels_last(channels_last) {}
+
+  void set_channels_last(bool enabled) { channels_last = enabled; }
+
+  void evaluate(const float* input, int batch_size, float* priors, float* values);
+};
+
+#endif // TORCHSCRIPT_EVALUATOR_H
@@ -0,0 +1,54 @@
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "tuning.h"
+
+
+TuningConfig TuningConfig::load(const std::string& path) {
+  std::ifstream fin(path);
+  if (! fin)
+    throw std::runtime_error("unable to read tuning config: " + path);
+
+  TuningConfig config;
+  std::string line;
+  while (std::getline(fin, line)) {
+    if (line.empty() || line[0] == '#')
+      continue;
+    auto split = line.find('=');
+    if (split == std::string::npos)
+      throw std::runtime_error("invalid line in tuning config: " + line);
+    auto key = line.substr(0, split);
+    int value;
+    try {
+      value = std::stoi(line.substr(split + 1));
+    }
+    catch (const std::logic_error&) {
+      throw std::runtime_error("invalid value in tuning config: " + line);
+    }
+    if (value < 1)
+      throw std::runtime_error("invalid value in tuning config: " + line);
+
+    if (key == "num_threads")
+      config.num_threads = value;
+    else if (key == "num_workers")
+      config.num_workers = value;
+    else if (key == "batch_size")
+      config.batch_size = value;
+    else
+      throw std::runtime_error("unknown key in tuning config: " + key);
+  }
+  return config;
+}
+
+
+void TuningConfig::save(const std::string& path, const std::string& comment) const {
+  std::ofstream fout(path);
+  std::istringstream comment_lines(comment);
+  std::string line;
+  while (std::getline(comment_lines, line))
+    fout << "# " << line << "\n";
+  fout << "num_threads=" << num_threads << "\n";
+  fout << "num_workers=" << num_workers << "\n";
+  fout << "batch_size=" << batch_size << "\n";
+}
@@ -0,0 +1,24 @@
+#ifndef TUNING_H
+#define TUNING_H
+
+#include <string>
+
+/// Inference settings for a host, as recommended by the autotune executable.
+/// Stored as a text file of key=value lines; blank lines and lines starting
+/// with '#' are ignored.
+struct TuningConfig {
+  // Intra-op threads for each process.
+  int num_threads = 1;
+  // Self-play processes to run concurrently.
+  int num_workers = 1;
+  // Batch size for evaluators that combine positions from several searches.
+  int batch_size = 1;
+
+  /// Throws std::runtime_error if the file can't be read or has an unknown
+  /// key or invalid value.
+  static TuningConfig load(const std::string& path);
+  /// Comment is written at the top of the file.
+  void save(const std::string& path, const std::string& comment = "") const;
+};
+
+#endif // TUNING_H
@@ -10,6 +10,9 @@
 
 #include "goboard.h"
 #include "zero/agent_zero.h"
+#include "zero/model_loader.h"
+#include "zero/tuning.h"
+#include "zero/resignation.h"
 #include "utils.h"
 #include "scoring.h"
 #include "simulation.h"
@@ -30,6 +33,19 @@ int main(int argc, const char* argv[]) {
     ("b,board-size", "Board size", cxxopts::value<int>()->default_value("9"))
     ("v,verbosity", "Verbosity level", cxxopts::value<int>()->default_value("0"))
     ("t,num-threads", "Number of pytorch threads", cxxopts::value<int>())
+    ("config", "Tuning configuration from autotune (num-threads takes precedence)", cxxopts::value<std::string>())
+    ("quantized", "Use int8 inference (calibrated native networks only)")
+    ("save-optimized", "Save the frozen TorchScript module for faster startup", cxxopts::value<std::string>())
+    ("early-stop", "Stop fast searches once the most visited move can't change")
+    ("graph", "Merge transpositions in the search tree")
+    ("gumbel", "Use Gumbel AlphaZero root search and record improved policy targets")
+    ("gumbel-moves", "Maximum number of root moves considered by Gumbel search", cxxopts::value<int>()->default_value("16"))
+    ("fast-rounds", "Rounds for fast searches with playout cap randomization (0 to disable)", cxxopts::value<int>()->default_value("0"))
+    ("full-search-prob", "Probability that a move uses a full search with playout cap randomization", cxxopts::value<float>()->default_value("0.25"))
+    ("record-fast", "Record positions from fast searches as value-only training data")
+    ("resign", "Initial resignation threshold on the root value (enables resignation)", cxxopts::value<float>())
+    ("resign-playthrough", "Fraction of games played through without resignation", cxxopts::value<float>()->default_value("0.1"))
+    ("resign-fp-rate", "Target false positive rate used to tune the resignation threshold", cxxopts::value<float>()->default_value("0.05"))
     ("h,help", "Print usage")
     ;
 
@@ -64,6 +80,18 @@ int main(int argc, const char* argv[]) {
   auto save_interval = args["save-every"].as<int>();
   auto board_size = args["board-size"].as<int>();
   auto verbosity = args["verbosity"].as<int>();
+  auto early_stopping = args.count("early-stop") > 0;
+  auto graph_search = args.count("graph") > 0;
+  auto gumbel = args.count("gumbel") > 0;
+  auto gumbel_moves = args["gumbel-moves"].as<int>();
+  auto fast_rounds = args["fast-rounds"].as<int>();
+  auto full_search_prob = args["full-search-prob"].as<float>();
+  auto record_fast = args.count("record-fast") > 0;
+  std::unique_ptr<ResignationManager> resignation;
+  if (args.count("resign"))
+    resignation = std::make_unique<ResignationManager>(args["resign"].as<float>(),
+                                                       args["resign-playthrough"].as<float>(),
+                                                       args["resign-fp-rate"].as<float>());
   if (args.count("output-path")) {
     output_path = args["output-path"].as<std::string>();
     store_experience = true;
@@ -88,38 +116,81 @@ int main(int argc, const char* argv[]) {
     std::cout << "setting " << args["num-threads"].as<int>() << " pytorch threads" << std::endl;
     at::set_num_threads(args["num-threads"].as<int>());
   }
+  else if (args.count("config")) {
+    try {
+      auto config = TuningConfig::load(args["config"].as<std::string>());
+      std::cout << "setting " << config.num_threads << " pytorch threads from config" << std::endl;
+      at::set_num_threads(config.num_threads);
+    }
+    catch (const std::runtime_error& e) {
+      std::cerr << e.what() << std::endl;
+      exit(1);
+    }
+  }
 
   c10::InferenceMode guard;
-  torch::jit::script::Module model;
+  auto network_path = args["network"].as<std::string>();
+  auto encoder = std::make_shared<SimpleEncoder>(board_size);
+  std::shared_ptr<Evaluator> evaluator;
+
+  ModelLoadOptions load_options;
+  load_options.quantized = args.count("quantized") > 0;
+  if (args.count("save-optimized"))
+    load_options.save_path = args["save-optimized"].as<std::string>();
   try {
-    // Deserialize the ScriptModule from a file using torch::jit::load().
-    model = torch::jit::load(args["network"].as<std::string>());
+    evaluator = load_evaluator(network_path, *encoder, load_options);
   }
-  catch (const c10::Error& e) {
-    std::cerr << "error loading the model\n";
+  catch (const std::runtime_error& e) {
+    std::cerr << e.what() << std::endl;
     return -1;
   }
 
-  std::cout << "Model loaded\n";
-
-  auto encoder = std::make_shared<SimpleEncoder>(board_size);
-
   auto black_collector = std::make_shared<ExperienceCollector>();
   auto white_collector = std::make_shared<ExperienceCollector>();
 
-  auto black_agent = std::make_unique<ZeroAgent>(model, encoder, num_rounds, false);
-  auto white_agent = std::make_unique<ZeroAgent>(model, encoder, num_rounds, false);
+  auto black_agent = std::make_unique<ZeroAgent>(evaluator, encoder, num_rounds, false);
+  auto white_agent = std::make_unique<ZeroAgent>(evaluator, encoder, num_rounds, false);
 
   black_agent->set_collector(black_collector);
   white_agent->set_collector(white_collector);
 
+  black_agent->set_root_noise(true);
+  white_agent->set_root_noise(true);
+
+  black_agent->set_early_stopping(early_stopping);
+  white_agent->set_early_stopping(early_stopping);
+
+  black_agent->set_graph_search(graph_search);
+  white_agent->set_graph_search(graph_search);
+
+  black_agent->set_gumbel(gumbel, gumbel_moves);
+  white_agent->set_gumbel(gumbel, gumbel_moves);
+
+  if (fast_rounds > 0) {
+    black_agent->set_playout_cap(fast_rounds, full_search_prob, record_fast);
+    white_agent->set_playout_cap(fast_rounds, full_search_prob, record_fast);
+  }
+
   int num_black_wins = 0;
   int save_counter = 0;
   int total_num_moves = 0;
   auto cumulative_timer = Timer();
   for (int game_num=0; game_num < num_games; ++game_num) {
+    if (resignation) {
+      auto threshold = resignation->begin_game();
+      black_agent->set_resign_threshold(threshold);
+      white_agent->set_resign_threshold(threshold);
+      black_agent->reset_min_root_value();
+      white_agent->reset_min_root_value();
+    }
+
     auto timer = Timer();
     auto [winner, num_moves] = simulate_game(board_size, black_agent.get(), white_agent.get(), verbosity, max_moves);
+
+    if (resignation) {
+      auto winner_agent = winner == Player::black ? black_agent.get() : white_agent.get();
+      resignation->complete_game(winner_agent->get_min_root_value());
+    }
     auto duration = timer.elapsed();
     total_num_moves += num_moves;
     if (num_games <= 5) {
@@ -135,6 +206,35 @@ int main(int argc, const char* argv[]) {
     std::cout << ", " << total_num_moves / (game_num + 1) << " mpg";
     std::cout << std::defaultfloat << std::setprecision(4);
     std::cout << ", " << total_num_moves / total_duration << " mps";
+    if (early_stopping) {
+      auto rounds_saved = black_agent->get_stats().rounds_saved + white_agent->get_stats().rounds_saved;
+      std::cout << std::fixed << std::setprecision(1);
+      std::cout << ", " << static_cast<double>(rounds_saved) / total_num_moves << " saved rpm";
+      std::cout << std::defaultfloat << std::setprecision(4);
+    }
+    if (graph_search) {
+      const auto& black_stats = black_agent->get_stats();
+      const auto& white_stats = white_agent->get_stats();
+      auto num_merged = black_stats.num_transpositions + white_stats.num_transpositions;
+      auto num_expansions = num_merged + black_stats.num_evaluations + white_stats.num_evaluations;
+      std::cout << std::fixed << std::setprecision(1);
+      std::cout << ", " << 100.0 * num_merged / num_expansions << "% merged";
+      std::cout << std::defaultfloat << std::setprecision(4);
+    }
+    if (fast_rounds > 0) {
+      auto num_full = black_agent->get_stats().num_full_searches + white_agent->get_stats().num_full_searches;
+      std::cout << std::fixed << std::setprecision(1);
+      std::cout << ", " << 100.0 * num_full / total_num_moves << "% full";
+      std::cout << std::defaultfloat << std::setprecision(4);
+    }
+    if (resignation) {
+      std::cout << std::fixed << std::setprecision(3);
+      std::cout << ", resign " << resignation->get_threshold();
+      std::cout << std::setprecision(1);
+      std::cout << " (" << 100.0 * resignation->false_positive_rate() << "% fp of "
+                << resignation->get_num_playthrough_games() << ")";
+      std::cout << std::defaultfloat << std::setprecision(4);
+    }
     std::cout << "  [" << format_seconds(total_duration) << " < " << format_seconds(remaining_sec) << "]" << std::endl;
 
     auto black_reward = winner == Player::black ? 1.0 : -1.0;
@@ -37,7 +37,10 @@ class ExperienceSet(ConcatDataset):
         triples = [[os.path.join(directory, f'{key}{label}.json')
                     for key in ('states', 'rewards', 'visit_counts')]
                    for label in labels]
-        datasets = [AugmentedExperienceChunk(*triple) for triple in triples]
+        full_search_paths = [os.path.join(directory, f'full_search{label}.json')
+                             for label in labels]
+        datasets = [AugmentedExperienceChunk(*triple, full_search_path=path)
+                    for triple, path in zip(triples, full_search_paths)]
         super().__init__(datasets)
 
 
@@ -46,9 +49,12 @@ class ExperienceChunk(Dataset):
 
     Intent is for these to be collected using ChainDataSet.
     """
-    def __init__(self, states_path, rewards_path, visit_counts_path):
+    def __init__(self, states_path, rewards_path, visit_counts_path, full_search_path=None):
         """Args:
         path (str): Path to states json file.
+        full_search_path (str): Path to json file flagging positions that
+            were searched with the full number of rounds.  If missing (older
+            experience), all positions are treated as full searches.
         """
         self.states_path = states_path
         self.rewards_path = rewards_path
@@ -62,6 +68,10 @@ class ExperienceChunk(Dataset):
             self.rewards_info = json.load(f)
         with open(visit_counts_path, 'r') as f:
             self.visit_counts_info = json.load(f)
+        self.full_search_info = None
+        if full_search_path and os.path.exists(full_search_path):
+            with open(full_search_path, 'r') as f:
+                self.full_search_info = json.load(f)
 
         self.num_moves = self.states_info['shape'][0]
         strides = self.states_info['strides']
@@ -81,7 +91,12 @@ class ExperienceChunk(Dataset):
         memmaps = [self._memmap_data(info) for info in (
             self.states_info, self.rewards_info, self.visit_counts_info)]
 
-        return [torch.tensor(m[idx]) for m in memmaps]
+        items = [torch.tensor(m[idx]) for m in memmaps]
+        if self.full_search_info:
+            items.append(torch.tensor(self._memmap_data(self.full_search_info)[idx]))
+        else:
+            items.append(torch.tensor(1.0))
+        return items
 
 
 class AugmentedExperienceChunk(ExperienceChunk):
@@ -89,8 +104,8 @@ class AugmentedExperienceChunk(ExperienceChunk):
 
     Note that this depends on the structure of the policy output, e.g., whether it includes a pass move.
     """
-    def __init__(self, *args):
-        super().__init__(*args)
+    def __init__(self, *args, **kwargs):
+        super().__init__(*args, **kwargs)
         self.num_original = super().__len__()
 
     def __len__(self):
@@ -102,7 +117,7 @@ class AugmentedExperienceChunk(ExperienceChunk):
 
         base_idx = idx % self.num_original
         # print('base idx:', base_idx)
-        state, reward, visit_counts = super().__getitem__(base_idx)
+        state, reward, visit_counts, full_search = super().__getitem__(base_idx)
         state = transform.forward(state)
 
         # Visit counts has shape [board_size^2 + 1]
@@ -113,7 +128,7 @@ class AugmentedExperienceChunk(ExperienceChunk):
         visit_counts = torch.cat((board_visit_counts.reshape(board_size * board_size), visit_counts[-1:]))
         assert torch.numel(visit_counts) == board_size * board_size + 1
 
-        return state, reward, visit_counts
+        return state, reward, visit_counts, full_search
 
 
 
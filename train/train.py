@@ -7,7 +7,15 @@ import click
 from data import ExperienceSubset
 
 
-def cross_entropy_loss_fn(policies, visit_counts):
+def cross_entropy_loss_fn(policies, visit_counts, full_search):
+    # Only positions from full searches have policy targets.  Fast searches
+    # from playout cap randomization are recorded with zero visit counts.
+    mask = full_search > 0
+    if not mask.any():
+        return torch.zeros(())
+    policies = policies[mask]
+    visit_counts = visit_counts[mask]
+
     search_probs = visit_counts / visit_counts.sum(1, keepdims=True)
     assert search_probs[0].sum() > 0.999 and search_probs[0].sum() < 1.001
 
@@ -21,13 +29,13 @@ def train(dataloader, model, optimizer, output_interval):
     size = len(dataloader.dataset)
     num_batches = len(dataloader)
     model.train()
-    for batch_num, (states, rewards, visit_counts) in enumerate(dataloader):
+    for batch_num, (states, rewards, visit_counts, full_search) in enumerate(dataloader):
 
         # Compute prediction error
         policies, values = model(states)
 
         mse_loss = mse_loss_fn(values.squeeze(), rewards)
-        cross_entropy_loss = cross_entropy_loss_fn(policies, visit_counts)
+        cross_entropy_loss = cross_entropy_loss_fn(policies, visit_counts, full_search)
 
         loss = mse_loss + cross_entropy_loss
 